@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cairo.h>
+
+namespace abcd {
+
+// ---------------------------------------------------------
+// GLYPH ATLAS
+// ---------------------------------------------------------
+
+/**
+ * blends n pixels of solid color (0xAARRGGBB, straight alpha) through
+ * the coverage bytes into premultiplied ARGB32 pixels
+ */
+
+inline void blend_a8(uint32_t *dst, const uint8_t *coverage, int n, uint32_t color)
+{
+	uint32_t a = color >> 24;
+
+	// premultiplied source, then scaled by the coverage of each pixel
+
+	uint32_t r = ((color >> 16 & 0xFF) * a + 127) / 255;
+	uint32_t g = ((color >> 8 & 0xFF) * a + 127) / 255;
+	uint32_t b = ((color & 0xFF) * a + 127) / 255;
+
+	int i = 0;
+
+#if defined(__SSE2__)
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32(a << 24 | r << 16 | g << 8 | b), zero);
+	const __m128i alpha = _mm_set1_epi16(a);
+
+	// x / 255 for x <= 255 * 255, rounded
+	auto div255 = [&](__m128i x)
+	{
+		x = _mm_add_epi16(x, c128);
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	};
+
+	auto blend = [&](__m128i d, __m128i m)
+	{
+		__m128i k = div255(_mm_mullo_epi16(alpha, m));
+		return _mm_add_epi16(div255(_mm_mullo_epi16(src, m)), 
+			div255(_mm_mullo_epi16(d, _mm_sub_epi16(c255, k))));
+	};
+
+	for (; i + 4 <= n; i += 4)
+	{
+		int32_t cov;
+		memcpy(&cov, coverage + i, 4);
+
+		// glyph bitmaps are mostly empty around the strokes
+		if (cov == 0)
+			continue;
+
+		__m128i m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(cov), zero);
+		m = _mm_unpacklo_epi16(m, m);
+
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i lo = blend(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(m, m));
+		__m128i hi = blend(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(m, m));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+#endif
+
+	for (; i < n; ++i)
+	{
+		uint32_t m = coverage[i];
+		if (m == 0)
+			continue;
+
+		auto div255 = [](uint32_t x) {x += 128; return (x + (x >> 8)) >> 8;};
+
+		uint32_t d = dst[i];
+		uint32_t inv = 255 - div255(a * m);
+
+		dst[i] = (div255(a * m) + div255((d >> 24) * inv)) << 24
+			| (div255(r * m) + div255((d >> 16 & 0xFF) * inv)) << 16
+			| (div255(g * m) + div255((d >> 8 & 0xFF) * inv)) << 8
+			| (div255(b * m) + div255((d & 0xFF) * inv));
+	}
+}
+
+/**
+ * coverage of every (font, size, glyph) drawn so far, rasterized once by
+ * cairo into an A8 page and then blended straight into the target pixels
+ * (see Draw::set_glyph_atlas()). One atlas can serve the Draw instances
+ * of a thread; when its page is full it starts over
+ */
+
+class glyph_atlas
+{
+public:
+
+	struct glyph
+	{
+		uint16_t x, y, w, h;		// in the page, w == 0 for blanks
+		int16_t left, top;		// from the pen position to the bitmap
+		float x_bearing, width;		// ink extents, for measuring
+		float advance;
+	};
+
+private:
+
+	struct font
+	{
+		cairo_font_face_t *face;
+		float size;
+		glyph ascii[128];
+		bool has_ascii[128] {};
+		std::unordered_map<uint32_t, glyph> other;
+	};
+
+	int m_width, m_height, m_stride;
+	std::unique_ptr<uint8_t[]> m_page;
+	cairo_surface_t *m_surface;
+	cairo_t *m_cr;
+
+	// shelf packing: glyphs go left to right on the current shelf
+	int m_shelf_x {0};
+	int m_shelf_y {0};
+	int m_shelf_h {0};
+
+	std::vector<std::unique_ptr<font>> m_fonts;
+	font *m_font {nullptr};		// the font set on m_cr
+
+	static uint32_t next_codepoint(const char *&s)
+	{
+		auto p = (const uint8_t *)s;
+		uint32_t c = *p++;
+		int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+
+		if (extra)
+			c &= 0x3F >> extra;
+
+		for (; extra > 0 && (*p & 0xC0) == 0x80; --extra)
+			c = c << 6 | (*p++ & 0x3F);
+
+		s = (const char *)p;
+		return c;
+	}
+
+	font *find_font(cairo_font_face_t *face, float size)
+	{
+		for (auto &f : m_fonts)
+			if (f->face == face && f->size == size)
+				return f.get();
+
+		auto f = new font;
+		f->face = cairo_font_face_reference(face);
+		f->size = size;
+		m_fonts.emplace_back(f);
+
+		return f;
+	}
+
+	void start_over()
+	{
+		memset(m_page.get(), 0, size_t(m_stride) * m_height);
+		cairo_surface_mark_dirty(m_surface);
+
+		for (auto &f : m_fonts)
+		{
+			memset(f->has_ascii, 0, sizeof(f->has_ascii));
+			f->other.clear();
+		}
+
+		m_shelf_x = m_shelf_y = m_shelf_h = 0;
+	}
+
+	glyph rasterize(font *f, uint32_t c)
+	{
+		if (m_font != f)
+		{
+			cairo_set_font_face(m_cr, f->face);
+			cairo_set_font_size(m_cr, f->size);
+			m_font = f;
+		}
+
+		char utf8[5] {};
+		if (c < 0x80)
+			utf8[0] = c;
+		else if (c < 0x800)
+		{
+			utf8[0] = 0xC0 | c >> 6;
+			utf8[1] = 0x80 | (c & 0x3F);
+		}
+		else if (c < 0x10000)
+		{
+			utf8[0] = 0xE0 | c >> 12;
+			utf8[1] = 0x80 | (c >> 6 & 0x3F);
+			utf8[2] = 0x80 | (c & 0x3F);
+		}
+		else
+		{
+			utf8[0] = 0xF0 | c >> 18;
+			utf8[1] = 0x80 | (c >> 12 & 0x3F);
+			utf8[2] = 0x80 | (c >> 6 & 0x3F);
+			utf8[3] = 0x80 | (c & 0x3F);
+		}
+
+		glyph g {};
+
+		auto sf = cairo_get_scaled_font(m_cr);
+		cairo_glyph_t *glyphs = nullptr;
+		int count = 0;
+
+		if (cairo_scaled_font_text_to_glyphs(sf, 0, 0, utf8, -1, &glyphs, &count, 
+			nullptr, nullptr, nullptr) != CAIRO_STATUS_SUCCESS || count == 0)
+		{
+			return g;
+		}
+
+		cairo_glyph_t gl = glyphs[0];
+		cairo_glyph_free(glyphs);
+
+		cairo_text_extents_t te;
+		cairo_scaled_font_glyph_extents(sf, &gl, 1, &te);
+
+		g.x_bearing = te.x_bearing;
+		g.width = te.width;
+		g.advance = te.x_advance;
+
+		if (te.width <= 0 || te.height <= 0)
+			return g;
+
+		// one pixel of margin for the antialiasing
+
+		int x0 = int(floor(te.x_bearing)) - 1;
+		int y0 = int(floor(te.y_bearing)) - 1;
+		int w = int(ceil(te.x_bearing + te.width)) + 1 - x0;
+		int h = int(ceil(te.y_bearing + te.height)) + 1 - y0;
+
+		if (w > m_width || h > m_height)
+			return g;
+
+		if (m_shelf_x + w > m_width)
+		{
+			m_shelf_x = 0;
+			m_shelf_y += m_shelf_h;
+			m_shelf_h = 0;
+		}
+
+		if (m_shelf_y + h > m_height)
+		{
+			start_over();
+			m_font = nullptr;
+			return rasterize(f, c);
+		}
+
+		g.x = m_shelf_x;
+		g.y = m_shelf_y;
+		g.w = w;
+		g.h = h;
+		g.left = x0;
+		g.top = y0;
+
+		m_shelf_x += w;
+		m_shelf_h = std::max(m_shelf_h, h);
+
+		gl.x = g.x - x0;
+		gl.y = g.y - y0;
+		cairo_show_glyphs(m_cr, &gl, 1);
+		cairo_surface_flush(m_surface);
+
+		return g;
+	}
+
+	const glyph &find(font *f, uint32_t c)
+	{
+		if (c < 128)
+		{
+			if (!f->has_ascii[c])
+			{
+				f->ascii[c] = rasterize(f, c);
+				f->has_ascii[c] = true;
+			}
+
+			return f->ascii[c];
+		}
+
+		auto it = f->other.find(c);
+		if (it != f->other.end())
+			return it->second;
+
+		return f->other.emplace(c, rasterize(f, c)).first->second;
+	}
+
+public:
+
+	glyph_atlas(int w = 1024, int h = 1024)
+		: m_width(w), m_height(h)
+	{
+		m_stride = cairo_format_stride_for_width(CAIRO_FORMAT_A8, w);
+		m_page.reset(new uint8_t[size_t(m_stride) * h]());
+		m_surface = cairo_image_surface_create_for_data(m_page.get(), 
+			CAIRO_FORMAT_A8, w, h, m_stride);
+		m_cr = cairo_create(m_surface);
+		cairo_set_source_rgba(m_cr, 0, 0, 0, 1);
+	}
+
+	~glyph_atlas()
+	{
+		cairo_destroy(m_cr);
+		cairo_surface_destroy(m_surface);
+		for (auto &f : m_fonts)
+			cairo_font_face_destroy(f->face);
+	}
+
+	glyph_atlas(const glyph_atlas &) = delete;
+	glyph_atlas &operator=(const glyph_atlas &) = delete;
+
+	/**
+	 * ink extents and advance of text, rasterizing the missing glyphs
+	 */
+
+	void text_extents(cairo_font_face_t *face, float size, const char *text, 
+		cairo_text_extents_t *te)
+	{
+		font *f = find_font(face, size);
+
+		float pen = 0;
+		float x1 = 0, x2 = 0;
+		bool ink = false;
+
+		while (*text)
+		{
+			auto &g = find(f, next_codepoint(text));
+
+			if (g.width > 0)
+			{
+				float gx1 = pen + g.x_bearing;
+				float gx2 = gx1 + g.width;
+				x1 = ink ? std::min(x1, gx1) : gx1;
+				x2 = ink ? std::max(x2, gx2) : gx2;
+				ink = true;
+			}
+
+			pen += g.advance;
+		}
+
+		memset(te, 0, sizeof(*te));
+		te->x_bearing = x1;
+		te->width = x2 - x1;
+		te->x_advance = pen;
+	}
+
+	/**
+	 * draws text in color (0xAARRGGBB, straight alpha) with its baseline
+	 * origin at pixel (x, y), within the clip rect (x1, y1, x2, y2)
+	 */
+
+	void draw_text(uint32_t *pixels, int stride, int x1, int y1, int x2, int y2, 
+		cairo_font_face_t *face, float size, const char *text, 
+		float x, float y, uint32_t color)
+	{
+		font *f = find_font(face, size);
+
+		int baseline = int(lround(y));
+		float pen = x;
+
+		while (*text)
+		{
+			auto &g = find(f, next_codepoint(text));
+
+			int gx = int(lround(pen)) + g.left;
+			int gy = baseline + g.top;
+			pen += g.advance;
+
+			int cx1 = std::max(gx, x1), cx2 = std::min(gx + g.w, x2);
+			int cy1 = std::max(gy, y1), cy2 = std::min(gy + g.h, y2);
+
+			if (cx1 >= cx2 || cy1 >= cy2)
+				continue;
+
+			for (int row = cy1; row < cy2; ++row)
+			{
+				auto dst = (uint32_t *)((uint8_t *)pixels + size_t(row) * stride) + cx1;
+				auto cov = m_page.get() + size_t(g.y + row - gy) * m_stride + g.x + cx1 - gx;
+				blend_a8(dst, cov, cx2 - cx1, color);
+			}
+		}
+	}
+};
+
+} // abcd
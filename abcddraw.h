@@ -22,9 +22,24 @@
 
 #pragma once
 
+#include <vector>
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <iterator>
+#include <initializer_list>
+#include <cstring>
+
 #include <cairomm/cairomm.h>
 #include <cairomm/enums.h>
 
+#include "abcdprofile.h"
+#include "abcdatlas.h"
+#include "abcdfont.h"
+
 namespace abcd {
 
 	struct point
@@ -40,37 +55,396 @@ namespace abcd {
 	struct rect
 	{
 		int x1, y1, x2, y2;
-		int width() {return x2 - x1;}
-		int height() {return y2 - y1;}
+		constexpr int width() const {return x2 - x1;}
+		constexpr int height() const {return y2 - y1;}
 
-		rect()
+		constexpr rect() : x1(0), y1(0), x2(0), y2(0)
 		{
-			x1 = y1 = x2 = y2 = 0;
 		}
 
-		rect(int x1, int y1, int x2, int y2)
+		constexpr rect(int x1, int y1, int x2, int y2)
+			: x1(x1), y1(y1), x2(x2), y2(y2)
 		{
-			this->x1 = x1; this->y1 = y1; 
-			this->x2 = x2; this->y2 = y2;
 		}
 	};
 
 
+// ---------------------------------------------------------
+// SLICE
+// ---------------------------------------------------------
+
+/**
+ * non-owning view of contiguous elements, so callers can pass vectors,
+ * arrays or brace lists without building a temporary container
+ */
+
+template <class T>
+class slice
+{
+	const T *m_data {nullptr};
+	size_t m_size {0};
+
+public:
+
+	slice() {}
+	slice(const T *data, size_t size) : m_data(data), m_size(size) {}
+	slice(const std::vector<T> &v) : m_data(v.data()), m_size(v.size()) {}
+	slice(std::initializer_list<T> l) : m_data(std::data(l)), m_size(l.size()) {}
+
+	template <size_t N>
+	slice(const std::array<T, N> &a) : m_data(a.data()), m_size(N) {}
+
+	template <size_t N>
+	slice(const T (&a)[N]) : m_data(a), m_size(N) {}
+
+	const T *begin() const {return m_data;}
+	const T *end() const {return m_data + m_size;}
+	const T &operator[](size_t i) const {return m_data[i];}
+	size_t size() const {return m_size;}
+	bool empty() const {return m_size == 0;}
+};
+
 struct color
 {
 	uint8_t r, g, b, a;
 };
 
+// ---------------------------------------------------------
+// DISPLAY LIST
+// ---------------------------------------------------------
+
+/**
+ * binary recording of Draw calls (see Draw::record()), replayed by
+ * display_player into another Draw, later or in another process.
+ *
+ * a frame starts with "ADL", the format version and a flags byte, then
+ * one opcode per call: integers are zigzag varints, rects are x1, y1,
+ * width, height, floats are 4 little endian bytes. strings and colors
+ * are sent once, by op_string and op_color, and then referenced by
+ * index; the tables are kept across frames until reset(), so a frame
+ * carries only the strings and colors it introduces and the player
+ * must see every frame in order. begin_frame() resets them past
+ * max_strings or max_colors, so changing text keeps them bounded
+ */
+
+class display_list
+{
+public:
+
+	enum op : uint8_t
+	{
+		op_string = 1, op_color,
+		op_stroke_width, op_paint, op_clear,
+		op_stroke_rectangle, op_fill_rectangle,
+		op_stroke_rounded_rectangle, op_fill_rounded_rectangle,
+		op_stroke_arc, op_fill_arc,
+		op_add_rectangle, op_add_rounded_rectangle, op_add_arc,
+		op_add_rotated_rectangle, op_fill_path, op_stroke_path,
+		op_font, op_text, op_textline,
+		op_push, op_pop, op_clip, op_translate, op_rotate
+	};
+
+	static constexpr uint8_t version = 1;
+	static constexpr uint8_t flag_reset = 1;	// the player drops its tables
+
+	static constexpr size_t max_strings = 4096;
+	static constexpr size_t max_colors = 4096;
+
+private:
+
+	std::vector<uint8_t> m_data;
+	std::deque<std::string> m_strings;	// stable storage for the keys below
+	std::unordered_map<std::string_view, uint32_t> m_string_index;
+	std::unordered_map<uint32_t, uint32_t> m_color_index;
+	bool m_reset {true};
+
+	static uint32_t pack(color c)
+	{
+		return uint32_t(c.r) | uint32_t(c.g) << 8 | uint32_t(c.b) << 16 | uint32_t(c.a) << 24;
+	}
+
+	void put_varint(uint32_t v)
+	{
+		while (v >= 0x80)
+		{
+			m_data.push_back(uint8_t(v) | 0x80);
+			v >>= 7;
+		}
+		m_data.push_back(uint8_t(v));
+	}
+
+	void put(int v)
+	{
+		put_varint((uint32_t(v) << 1) ^ uint32_t(v >> 31));
+	}
+
+	void put(float v)
+	{
+		uint32_t u;
+		memcpy(&u, &v, 4);
+		for (int i = 0; i < 4; ++i)
+			m_data.push_back(uint8_t(u >> i * 8));
+	}
+
+	void put(point p)
+	{
+		put(p.x);
+		put(p.y);
+	}
+
+	void put(rect r)
+	{
+		put(r.x1);
+		put(r.y1);
+		put(r.width());
+		put(r.height());
+	}
+
+	void put(color c)
+	{
+		put_varint(m_color_index.find(pack(c))->second);
+	}
+
+	void put(const char *s)
+	{
+		put_varint(m_string_index.find(s)->second);
+	}
+
+	// strings and colors are defined before the op that uses them
+
+	template <class T>
+	void define(const T &)
+	{
+	}
+
+	void define(color c)
+	{
+		auto k = pack(c);
+		if (m_color_index.count(k))
+			return;
+
+		m_color_index.emplace(k, m_color_index.size());
+		m_data.push_back(op_color);
+		m_data.insert(m_data.end(), {c.r, c.g, c.b, c.a});
+	}
+
+	void define(const char *s)
+	{
+		if (m_string_index.count(s))
+			return;
+
+		auto &str = m_strings.emplace_back(s);
+		m_string_index.emplace(str, m_string_index.size());
+		m_data.push_back(op_string);
+		put_varint(str.size());
+		m_data.insert(m_data.end(), str.begin(), str.end());
+	}
+
+public:
+
+	/**
+	 * starts a new frame, dropping the data of the previous one
+	 */
+
+	void begin_frame()
+	{
+		// a clock or a meter defines new strings every frame; starting
+		// over costs one frame that sends its strings again
+
+		if (m_strings.size() > max_strings || m_color_index.size() > max_colors)
+			reset();
+
+		m_data.clear();
+		m_data.insert(m_data.end(), {'A', 'D', 'L', version, 
+			uint8_t(m_reset ? flag_reset : 0)});
+		m_reset = false;
+	}
+
+	/**
+	 * forgets the string and color tables, call between frames
+	 * (e.g. when a new player connects)
+	 */
+
+	void reset()
+	{
+		m_strings.clear();
+		m_string_index.clear();
+		m_color_index.clear();
+		m_reset = true;
+	}
+
+	template <class... A>
+	void record(op o, const A&... args)
+	{
+		(define(args), ...);
+		m_data.push_back(o);
+		(put(args), ...);
+	}
+
+	/**
+	 * strings defined since the last reset()
+	 */
+
+	size_t strings() const
+	{
+		return m_strings.size();
+	}
+
+	size_t colors() const
+	{
+		return m_color_index.size();
+	}
+
+	const uint8_t *data() const
+	{
+		return m_data.data();
+	}
+
+	size_t size() const
+	{
+		return m_data.size();
+	}
+};
+
+
 class Draw
 {
 	::Cairo::RefPtr<::Cairo::Context> m_cr;
 	::Cairo::RefPtr<::Cairo::ImageSurface> m_surface;
 
+	// font faces and their metrics outlive the context, so rebinding to
+	// another buffer or restoring a saved state costs no font lookups
+
+	struct font_metrics
+	{
+		float size;
+		cairo_font_extents_t extents;
+		float x_height;	// measured by text() on first use, -1 until then
+	};
+
+	struct font_face
+	{
+		std::string family;
+		::Cairo::RefPtr<::Cairo::FontFace> face;
+		std::vector<font_metrics> metrics;
+	};
+
+	struct state
+	{
+		font_face *font {nullptr};
+		size_t metrics {0};
+		float line_width {2};
+		color paint {0, 0, 0, 255};
+	};
+
+	std::vector<std::unique_ptr<font_face>> m_faces;
+	state m_state;
+	std::vector<state> m_saved;
+
+	std::vector<std::unique_ptr<uint8_t[]>> m_ring;
+	size_t m_ring_index {0};
+	int m_ring_width {0};
+	int m_ring_height {0};
+
+	display_list *m_list {nullptr};
+	bool m_render {true};
+
+	glyph_atlas *m_atlas {nullptr};
+
+	// records the call when a display list is attached, true when the
+	// call must not draw
+
+	template <class... A>
+	bool record_only(display_list::op o, const A&... args)
+	{
+		if (!m_list)
+			return false;
+
+		m_list->record(o, args...);
+		return !m_render;
+	}
+
 	void prepare()
 	{
 		m_cr->translate(0.5, 0.5);
 	}
 
+	font_metrics *metrics()
+	{
+		return m_state.font ? &m_state.font->metrics[m_state.metrics] : nullptr;
+	}
+
+	font_face *find_face(const char *family)
+	{
+		for (auto &f : m_faces)
+		{
+			if (f->family == family)
+			{
+				++font_hits;
+				return f.get();
+			}
+		}
+
+		++font_misses;
+
+		auto f = new font_face;
+		f->family = family;
+		f->face = font_registry::instance().face(family);
+		m_faces.emplace_back(f);
+
+		return f;
+	}
+
+	// text goes through the atlas when one is set, a font was chosen with
+	// set_font() and the transform is a plain translation; any other
+	// case (rotated text, fonts set by other means) goes through cairo
+
+	void measure(const char *text, cairo_text_extents_t *te)
+	{
+		if (m_atlas && m_state.font)
+			m_atlas->text_extents(m_state.font->face->cobj(), metrics()->size, text, te);
+		else
+			cairo_text_extents(m_cr->cobj(), text, te);
+	}
+
+	void show_text(const char *text, float x, float y)
+	{
+		cairo_t *cr = m_cr->cobj();
+
+		cairo_matrix_t m;
+		cairo_get_matrix(cr, &m);
+
+		if (!m_atlas || !m_state.font || m.xx != 1 || m.yy != 1 || m.xy != 0 || m.yx != 0)
+		{
+			cairo_move_to(cr, x, y);
+			cairo_show_text(cr, text);
+			return;
+		}
+
+		// clips are rectangles here, their device extents bound the drawing.
+		// Both ends are rounded alike, a pixel is in when its center is,
+		// so a clip on the half pixel grid of prepare() keeps its edges
+
+		double x1, y1, x2, y2;
+		cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+
+		int cx1 = std::max(0, int(ceil(x1 + m.x0 - 0.5)));
+		int cy1 = std::max(0, int(ceil(y1 + m.y0 - 0.5)));
+		int cx2 = std::min(width(), int(ceil(x2 + m.x0 - 0.5)));
+		int cy2 = std::min(height(), int(ceil(y2 + m.y0 - 0.5)));
+
+		if (cx1 >= cx2 || cy1 >= cy2)
+			return;
+
+		auto c = m_state.paint;
+
+		m_surface->flush();
+		m_atlas->draw_text((uint32_t *)pixels(), stride(), cx1, cy1, cx2, cy2, 
+			m_state.font->face->cobj(), metrics()->size, text, x + m.x0, y + m.y0, 
+			uint32_t(c.a) << 24 | uint32_t(c.r) << 16 | uint32_t(c.g) << 8 | c.b);
+		m_surface->mark_dirty(cx1, cy1, cx2 - cx1, cy2 - cy1);
+	}
+
 	void create_rounded_rectangle(rect r, int rx, int ry)
 	{
 		double s = ry / double(rx);
@@ -114,39 +488,264 @@ class Draw
 
 public:
 
-	Draw(uint8_t *pixels, int w, int h)
+	/**
+	 * draws on w x h ARGB32 pixels, rows stride bytes apart (w * 4 when 0)
+	 */
+
+	Draw(uint8_t *pixels, int w, int h, int stride = 0)
+	{
+		m_surface = ::Cairo::ImageSurface::create(
+			pixels, ::Cairo::Format::FORMAT_ARGB32, w, h, stride ? stride : w * 4) ;
+
+		m_cr = ::Cairo::Context::create(m_surface);
+
+		prepare();
+	}
+
+	/**
+	 * draws on a ring of buffers owned by the Draw, see create_ring()
+	 */
+
+	Draw(int w, int h, int buffers)
+	{
+		create_ring(buffers, w, h);
+	}
+
+	/**
+	 * moves drawing to other pixels (after a resize or a buffer swap);
+	 * font faces, metrics and the current font, stroke width and paint are kept
+	 */
+
+	void rebind(uint8_t *pixels, int w, int h, int stride = 0)
 	{
 		m_surface = ::Cairo::ImageSurface::create(
-			pixels, ::Cairo::Format::FORMAT_ARGB32, w, h, w * 4) ;
+			pixels, ::Cairo::Format::FORMAT_ARGB32, w, h, stride ? stride : w * 4) ;
 
 		m_cr = ::Cairo::Context::create(m_surface);
 
 		prepare();
+
+		m_saved.clear();
+
+		cairo_t *cr = m_cr->cobj();
+
+		if (m_state.font)
+		{
+			cairo_set_font_face(cr, m_state.font->face->cobj());
+			cairo_set_font_size(cr, metrics()->size);
+		}
+
+		cairo_set_line_width(cr, m_state.line_width);
+
+		auto &c = m_state.paint;
+		cairo_set_source_rgba(cr, c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0);
+	}
+
+	/**
+	 * allocates count w x h buffers and binds the first one; the host
+	 * presents the buffer just drawn while the next frame goes into
+	 * the following one
+	 */
+
+	void create_ring(int count, int w, int h)
+	{
+		m_ring.clear();
+
+		for (int i = 0; i < count; ++i)
+			m_ring.emplace_back(new uint8_t[size_t(w) * h * 4]());
+
+		m_ring_index = 0;
+		m_ring_width = w;
+		m_ring_height = h;
+
+		rebind(m_ring[0].get(), w, h);
+	}
+
+	/**
+	 * binds the next buffer of the ring and returns its pixels
+	 */
+
+	uint8_t *next_buffer()
+	{
+		m_ring_index = (m_ring_index + 1) % m_ring.size();
+		rebind(m_ring[m_ring_index].get(), m_ring_width, m_ring_height);
+		return m_ring[m_ring_index].get();
+	}
+
+	/**
+	 * buffer i of the ring, 0 being the one bound now and -1 the
+	 * previous one
+	 */
+
+	uint8_t *ring_buffer(int i)
+	{
+		int n = m_ring.size();
+		return m_ring[((int(m_ring_index) + i) % n + n) % n].get();
+	}
+
+	/**
+	 * records the following calls into list (nullptr stops recording);
+	 * with render false only queries and state changes reach cairo, for
+	 * a front end that ships the list instead of pixels
+	 */
+
+	void record(display_list *list, bool render = true)
+	{
+		m_list = list;
+		m_render = render || !list;
+	}
+
+	/**
+	 * takes the font faces and metrics another Draw measured (e.g. one
+	 * warmed up on a worker thread) that this one does not have yet
+	 */
+
+	void adopt_fonts(const Draw &from)
+	{
+		for (auto &f : from.m_faces)
+		{
+			font_face *face = nullptr;
+			for (auto &g : m_faces)
+			{
+				if (g->family == f->family)
+				{
+					face = g.get();
+					break;
+				}
+			}
+
+			if (!face)
+			{
+				m_faces.emplace_back(new font_face(*f));
+				continue;
+			}
+
+			for (auto &m : f->metrics)
+			{
+				bool found = false;
+				for (auto &n : face->metrics)
+					found = found || n.size == m.size;
+
+				if (!found)
+					face->metrics.push_back(m);
+			}
+		}
+	}
+
+	/**
+	 * draws text with the glyphs of atlas (nullptr for cairo), which
+	 * must outlive the Draw or be unset before it is destroyed
+	 */
+
+	void set_glyph_atlas(glyph_atlas *atlas)
+	{
+		m_atlas = atlas;
+	}
+
+	glyph_atlas *get_glyph_atlas()
+	{
+		return m_atlas;
+	}
+
+	// font cache statistics
+
+	uint32_t font_hits {0};
+	uint32_t font_misses {0};
+
+	// fills, strokes and texts sent to cairo
+
+	uint32_t draw_calls {0};
+
+	uint8_t *pixels()
+	{
+		return m_surface->get_data();
+	}
+
+	int stride()
+	{
+		return m_surface->get_stride();
+	}
+
+	/**
+	 * completes pending drawing, call before reading pixels()
+	 */
+
+	void flush()
+	{
+		m_surface->flush();
+	}
+
+	/**
+	 * tells cairo that r was written through pixels(), after flush()
+	 */
+
+	void mark_dirty(rect r)
+	{
+		m_surface->mark_dirty(r.x1, r.y1, r.width(), r.height());
+	}
+
+	int width()
+	{
+		return m_surface->get_width();
+	}
+
+	int height()
+	{
+		return m_surface->get_height();
 	}
 
 	void set_stroke_width(float width)
 	{
+		if (m_list)
+			m_list->record(display_list::op_stroke_width, width);
+
+		m_state.line_width = width;
 		m_cr->set_line_width(width);
 	}
 
 	void set_solid_paint(color c)
 	{
+		if (m_list)
+			m_list->record(display_list::op_paint, c);
+
+		m_state.paint = c;
 		m_cr->set_source_rgba(c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0);
 	}
 
 	void clear()
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_clear))
+			return;
+
+		++draw_calls;
+
 		m_cr->paint();
 	}
 
 	void stroke_rectangle(rect r)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_stroke_rectangle, r))
+			return;
+
+		++draw_calls;
+
 		m_cr->rectangle(r.x1, r.y1, r.width(), r.height());
 		m_cr->stroke();
 	}
 
 	void fill_rectangle(rect r)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_fill_rectangle, r))
+			return;
+
+		++draw_calls;
+
 		m_cr->rectangle(r.x1, r.y1, r.width(), r.height());
 		m_cr->fill();
 	}
@@ -154,18 +753,122 @@ public:
 
 	void stroke_rounded_rectangle(rect r, int rx, int ry)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_stroke_rounded_rectangle, r, rx, ry))
+			return;
+
+		++draw_calls;
+
 		create_rounded_rectangle(r, rx, ry);
 		m_cr->stroke();
 	}
 
 	void fill_rounded_rectangle(rect r, int rx, int ry)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_fill_rounded_rectangle, r, rx, ry))
+			return;
+
+		++draw_calls;
+
+		create_rounded_rectangle(r, rx, ry);
+		m_cr->fill();
+	}
+
+	// batched paths: add any number of shapes, then fill or stroke them
+	// all with one call
+
+	void add_rectangle(rect r)
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_add_rectangle, r))
+			return;
+
+		m_cr->rectangle(r.x1, r.y1, r.width(), r.height());
+	}
+
+	void add_rounded_rectangle(rect r, int rx, int ry)
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_add_rounded_rectangle, r, rx, ry))
+			return;
+
 		create_rounded_rectangle(r, rx, ry);
+	}
+
+	void add_arc(rect r, int sa, int ea)
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_add_arc, r, sa, ea))
+			return;
+
+		float xc = (r.x1 + r.x2) / 2.f;
+		float yc = (r.y1 + r.y2) / 2.f;
+		float w = r.width();
+		float h = r.height();
+
+		m_cr->save();
+		m_cr->translate(xc, yc);
+		if (w != h)
+			m_cr->scale(1, h / w);
+		m_cr->begin_new_sub_path();
+		m_cr->arc(0, 0, w / 2, sa * M_PI / 180, ea * M_PI / 180);
+		m_cr->close_path();
+		m_cr->restore();
+	}
+
+	void add_rotated_rectangle(point center, rect r, float degree)
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_add_rotated_rectangle, center, r, degree))
+			return;
+
+		m_cr->save();
+		m_cr->translate(center.x, center.y);
+		m_cr->rotate(degree * M_PI / 180);
+		m_cr->rectangle(r.x1, r.y1, r.width(), r.height());
+		m_cr->restore();
+	}
+
+	void fill_path()
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_fill_path))
+			return;
+
+		++draw_calls;
+
 		m_cr->fill();
 	}
 
+	void stroke_path()
+	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_stroke_path))
+			return;
+
+		++draw_calls;
+
+		m_cr->stroke();
+	}
+
 	void stroke_arc(rect r, int sa, int ea)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_stroke_arc, r, sa, ea))
+			return;
+
+		++draw_calls;
+
 		float xc = (r.x1 + r.x2) / 2;
 		float yc = (r.y1 + r.y2) / 2;
 		float w = r.width();
@@ -191,6 +894,13 @@ public:
 
 	void fill_arc(rect r, int sa, int ea)
 	{
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_fill_arc, r, sa, ea))
+			return;
+
+		++draw_calls;
+
 		float xc = (r.x1 + r.x2) / 2;
 		float yc = (r.y1 + r.y2) / 2;
 		float w = r.width();
@@ -217,47 +927,110 @@ public:
 
 
 
+	// text goes through the cairo C API: the cairomm wrappers take
+	// std::string and would allocate for every string that does not
+	// fit the small string buffer
+
 	float set_font(const char *family, float size) 
 	{
-		m_cr->select_font_face (family, ::Cairo::FONT_SLANT_NORMAL, ::Cairo::FONT_WEIGHT_NORMAL);
-		m_cr->set_font_size(size);
+		ABCD_PROFILE_FUNCTION();
 
-		::Cairo::FontExtents fe;
-		m_cr->get_font_extents(fe);
-		
-		float ratio = fe.height / size;
+		if (m_list)
+			m_list->record(display_list::op_font, family, size);
+
+		auto m = metrics();
 
-		return ratio;
+		if (m && m->size == size && m_state.font->family == family)
+		{
+			++font_hits;
+			return m->extents.height / size;
+		}
+
+		cairo_t *cr = m_cr->cobj();
+
+		auto f = find_face(family);
+		cairo_set_font_face(cr, f->face->cobj());
+		cairo_set_font_size(cr, size);
+
+		m_state.font = f;
+		m_state.metrics = f->metrics.size();
+
+		for (size_t i = 0; i < f->metrics.size(); ++i)
+		{
+			if (f->metrics[i].size == size)
+			{
+				m_state.metrics = i;
+				break;
+			}
+		}
+
+		if (m_state.metrics == f->metrics.size())
+		{
+			font_metrics fm;
+			fm.size = size;
+			fm.x_height = -1;
+			cairo_font_extents(cr, &fm.extents);
+			f->metrics.push_back(fm);
+		}
+
+		return metrics()->extents.height / size;
 	}
 
 	float get_font_height() 
 	{
-		::Cairo::FontExtents fe;
-		m_cr->get_font_extents(fe);
+		if (auto m = metrics())
+			return m->extents.height;
+
+		cairo_font_extents_t fe;
+		cairo_font_extents(m_cr->cobj(), &fe);
 		
 		return fe.height;
 	}
 
 	void text(const char *text, rect r, int xalign, int yalign) 
 	{
-		::Cairo::FontExtents fe;
-		m_cr->get_font_extents(fe);
+		ABCD_PROFILE_FUNCTION();
 
-		::Cairo::TextExtents te;
-		m_cr->get_text_extents(text, te);
+		if (record_only(display_list::op_text, text, r, xalign, yalign))
+			return;
 
-		::Cairo::TextExtents tex;
-		float xh = 0;
-		for (char c = 33; c < 127; ++c)
+		++draw_calls;
+
+		cairo_t *cr = m_cr->cobj();
+
+		cairo_font_extents_t fe;
+		auto m = metrics();
+
+		if (m)
+			fe = m->extents;
+		else
+			cairo_font_extents(cr, &fe);
+
+		cairo_text_extents_t te;
+		measure(text, &te);
+
+		float xh = m ? m->x_height : -1;
+
+		if (xh < 0)
 		{
-			char s[] = " ";
-			s[0] = c;
-			m_cr->get_text_extents(s, tex);
-			xh = xh + tex.height;
+			// average height of the printable ascii glyphs
+
+			cairo_text_extents_t tex;
+			xh = 0;
+			for (char c = 33; c < 127; ++c)
+			{
+				char s[] = " ";
+				s[0] = c;
+				cairo_text_extents(cr, s, &tex);
+				xh = xh + tex.height;
+			}
+
+			xh = xh / (127-33.f);
+
+			if (m)
+				m->x_height = xh;
 		}
 
-		xh = xh / (127-33.f);
-
 		float x, y;
 
 		switch (xalign)
@@ -276,63 +1049,450 @@ public:
 			default: y = r.y1 + r.height() / 2 - xh / 2 + xh; break;
 		}
 
-		m_cr->move_to(x, y);
-		m_cr->show_text(text);
+		show_text(text, x, y);
 	}
 
 	void draw_textline(const char *text, point pt)
 	{
-		::Cairo::FontExtents fe;
-		m_cr->get_font_extents(fe);
+		ABCD_PROFILE_FUNCTION();
+
+		if (record_only(display_list::op_textline, text, pt))
+			return;
+
+		++draw_calls;
 
-		::Cairo::TextExtents te;
-		m_cr->get_text_extents(text, te);
+		cairo_t *cr = m_cr->cobj();
+
+		cairo_font_extents_t fe;
+		if (auto m = metrics())
+			fe = m->extents;
+		else
+			cairo_font_extents(cr, &fe);
 
 		float x = pt.x /*+ te.x_bearing*/;
 		float y = pt.y + fe.ascent;
 
-		m_cr->move_to(x, y);
-		m_cr->show_text(text);
+		show_text(text, x, y);
 	}
 
 	size get_textline_size(const char *text)
 	{
-		::Cairo::FontExtents fe;
-		m_cr->get_font_extents(fe);
+		ABCD_PROFILE_FUNCTION();
+
+		cairo_t *cr = m_cr->cobj();
+
+		cairo_font_extents_t fe;
+		if (auto m = metrics())
+			fe = m->extents;
+		else
+			cairo_font_extents(cr, &fe);
 
-		::Cairo::TextExtents te;
-		m_cr->get_text_extents(text, te);
+		cairo_text_extents_t te;
+		measure(text, &te);
 
 		return {int(te.x_bearing + te.x_advance), int(fe.ascent + fe.descent)};
 	}
 
 	void push()
 	{
+		if (m_list)
+			m_list->record(display_list::op_push);
+
+		m_saved.push_back(m_state);
 		m_cr->save();
 	}
 
 	void pop()
 	{
+		if (m_list)
+			m_list->record(display_list::op_pop);
+
+		if (!m_saved.empty())
+		{
+			m_state = m_saved.back();
+			m_saved.pop_back();
+		}
+
 		m_cr->restore();
 	}
 
 	void clip(rect r)
 	{
+		if (m_list)
+			m_list->record(display_list::op_clip, r);
+
 		m_cr->rectangle(r.x1, r.y1, r.width(), r.height());
 		m_cr->clip();
 	}
 
 	void translate(point pt)
 	{
+		if (m_list)
+			m_list->record(display_list::op_translate, pt);
+
 		m_cr->translate(pt.x, pt.y);
 	}
 
 	void rotate(float degree)
 	{
+		if (m_list)
+			m_list->record(display_list::op_rotate, degree);
+
 		m_cr->rotate(degree * M_PI / 180);
 	}
 
 };
 
 
+/**
+ * replays the frames of a display_list into a Draw
+ */
+
+class display_player
+{
+	std::vector<std::string> m_strings;
+	std::vector<color> m_colors;
+
+	const uint8_t *m_p {nullptr};
+	const uint8_t *m_end {nullptr};
+	bool m_ok {true};
+
+	uint8_t get_byte()
+	{
+		if (m_p == m_end)
+		{
+			m_ok = false;
+			return 0;
+		}
+
+		return *m_p++;
+	}
+
+	uint32_t get_varint()
+	{
+		uint32_t v = 0;
+		for (int shift = 0; shift < 35 && m_ok; shift += 7)
+		{
+			uint8_t b = get_byte();
+			v |= uint32_t(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+
+		m_ok = false;
+		return 0;
+	}
+
+	int get_int()
+	{
+		uint32_t v = get_varint();
+		return int(v >> 1) ^ -int(v & 1);
+	}
+
+	float get_float()
+	{
+		uint32_t u = 0;
+		for (int i = 0; i < 4; ++i)
+			u |= uint32_t(get_byte()) << i * 8;
+
+		float v;
+		memcpy(&v, &u, 4);
+		return v;
+	}
+
+	point get_point()
+	{
+		point p;
+		p.x = get_int();
+		p.y = get_int();
+		return p;
+	}
+
+	rect get_rect()
+	{
+		rect r;
+		r.x1 = get_int();
+		r.y1 = get_int();
+		r.x2 = r.x1 + get_int();
+		r.y2 = r.y1 + get_int();
+		return r;
+	}
+
+	color get_color()
+	{
+		uint32_t i = get_varint();
+		if (i < m_colors.size())
+			return m_colors[i];
+
+		m_ok = false;
+		return {};
+	}
+
+	const char *get_string()
+	{
+		uint32_t i = get_varint();
+		if (i < m_strings.size())
+			return m_strings[i].c_str();
+
+		m_ok = false;
+		return "";
+	}
+
+public:
+
+	/**
+	 * draws one frame; returns false, having drawn the calls before the
+	 * fault, when the data is truncated, corrupt or of another version.
+	 * pushes left open are popped, so draw keeps its clip and transform
+	 */
+
+	bool play(const uint8_t *data, size_t size, Draw *draw)
+	{
+		m_p = data;
+		m_end = data + size;
+		m_ok = size >= 5 && memcmp(data, "ADL", 3) == 0 && data[3] == display_list::version;
+
+		if (!m_ok)
+			return false;
+
+		if (data[4] & display_list::flag_reset)
+		{
+			m_strings.clear();
+			m_colors.clear();
+		}
+
+		m_p += 5;
+
+		int depth = 0;
+
+		while (m_ok && m_p < m_end)
+		{
+			uint8_t o = get_byte();
+
+			switch (o)
+			{
+				case display_list::op_string:
+				{
+					uint32_t n = get_varint();
+					if (!m_ok || n > size_t(m_end - m_p))
+						return false;
+
+					m_strings.emplace_back((const char *)m_p, n);
+					m_p += n;
+					break;
+				}
+
+				case display_list::op_color:
+				{
+					color c;
+					c.r = get_byte();
+					c.g = get_byte();
+					c.b = get_byte();
+					c.a = get_byte();
+					m_colors.push_back(c);
+					break;
+				}
+
+				// arguments are read into locals first: their order of
+				// evaluation in a call is unspecified
+
+				case display_list::op_stroke_width:
+				{
+					float w = get_float();
+					if (m_ok)
+						draw->set_stroke_width(w);
+					break;
+				}
+
+				case display_list::op_paint:
+				{
+					color c = get_color();
+					if (m_ok)
+						draw->set_solid_paint(c);
+					break;
+				}
+
+				case display_list::op_clear:
+					draw->clear();
+					break;
+
+				case display_list::op_stroke_rectangle:
+				{
+					rect r = get_rect();
+					if (m_ok)
+						draw->stroke_rectangle(r);
+					break;
+				}
+
+				case display_list::op_fill_rectangle:
+				{
+					rect r = get_rect();
+					if (m_ok)
+						draw->fill_rectangle(r);
+					break;
+				}
+
+				case display_list::op_stroke_rounded_rectangle:
+				case display_list::op_fill_rounded_rectangle:
+				case display_list::op_add_rounded_rectangle:
+				{
+					rect r = get_rect();
+					int rx = get_int();
+					int ry = get_int();
+					if (!m_ok)
+						break;
+
+					if (o == display_list::op_stroke_rounded_rectangle)
+						draw->stroke_rounded_rectangle(r, rx, ry);
+					else if (o == display_list::op_fill_rounded_rectangle)
+						draw->fill_rounded_rectangle(r, rx, ry);
+					else
+						draw->add_rounded_rectangle(r, rx, ry);
+					break;
+				}
+
+				case display_list::op_stroke_arc:
+				case display_list::op_fill_arc:
+				case display_list::op_add_arc:
+				{
+					rect r = get_rect();
+					int sa = get_int();
+					int ea = get_int();
+					if (!m_ok)
+						break;
+
+					if (o == display_list::op_stroke_arc)
+						draw->stroke_arc(r, sa, ea);
+					else if (o == display_list::op_fill_arc)
+						draw->fill_arc(r, sa, ea);
+					else
+						draw->add_arc(r, sa, ea);
+					break;
+				}
+
+				case display_list::op_add_rectangle:
+				{
+					rect r = get_rect();
+					if (m_ok)
+						draw->add_rectangle(r);
+					break;
+				}
+
+				case display_list::op_add_rotated_rectangle:
+				{
+					point c = get_point();
+					rect r = get_rect();
+					float degree = get_float();
+					if (m_ok)
+						draw->add_rotated_rectangle(c, r, degree);
+					break;
+				}
+
+				case display_list::op_fill_path:
+					draw->fill_path();
+					break;
+
+				case display_list::op_stroke_path:
+					draw->stroke_path();
+					break;
+
+				case display_list::op_font:
+				{
+					const char *family = get_string();
+					float size = get_float();
+					if (m_ok)
+						draw->set_font(family, size);
+					break;
+				}
+
+				case display_list::op_text:
+				{
+					const char *text = get_string();
+					rect r = get_rect();
+					int xalign = get_int();
+					int yalign = get_int();
+					if (m_ok)
+						draw->text(text, r, xalign, yalign);
+					break;
+				}
+
+				case display_list::op_textline:
+				{
+					const char *text = get_string();
+					point pt = get_point();
+					if (m_ok)
+						draw->draw_textline(text, pt);
+					break;
+				}
+
+				case display_list::op_push:
+					draw->push();
+					++depth;
+					break;
+
+				// a pop without its push would restore the state of
+				// the caller, or fail in cairo
+
+				case display_list::op_pop:
+					if (depth == 0)
+					{
+						m_ok = false;
+						break;
+					}
+					draw->pop();
+					--depth;
+					break;
+
+				case display_list::op_clip:
+				{
+					rect r = get_rect();
+					if (m_ok)
+						draw->clip(r);
+					break;
+				}
+
+				case display_list::op_translate:
+				{
+					point pt = get_point();
+					if (m_ok)
+						draw->translate(pt);
+					break;
+				}
+
+				case display_list::op_rotate:
+				{
+					float degree = get_float();
+					if (m_ok)
+						draw->rotate(degree);
+					break;
+				}
+
+				default:
+					m_ok = false;
+					break;
+			}
+		}
+
+		// the Draw is left as it was given, whatever the data
+
+		for (; depth > 0; --depth)
+			draw->pop();
+
+		return m_ok;
+	}
+
+	// strings and colors held for the frames to come
+
+	size_t strings() const
+	{
+		return m_strings.size();
+	}
+
+	size_t colors() const
+	{
+		return m_colors.size();
+	}
+};
+
+
 } // abcd
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <cairo-ft.h>
+
+#include "abcdfont.h"
+
+namespace abcd {
+
+font_registry &font_registry::instance()
+{
+	static font_registry *registry = new font_registry;
+	return *registry;
+}
+
+void font_registry::done_face(void *ft)
+{
+	std::lock_guard<std::mutex> lock(instance().m_library_mutex);
+	FT_Done_Face((FT_Face)ft);
+}
+
+bool font_registry::add_file(const char *family, const char *path, int index)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	FT_Face ft;
+	{
+		std::lock_guard<std::mutex> ft_lock(m_library_mutex);
+
+		if (!m_library)
+		{
+			FT_Library library;
+			if (FT_Init_FreeType(&library) != 0)
+				return false;
+			m_library = library;
+		}
+
+		if (FT_New_Face((FT_Library)m_library, path, index, &ft) != 0)
+			return false;
+	}
+
+	// the FreeType face is released with the last reference to the
+	// cairo face, by the Draw instances still using a replaced one
+
+	static const cairo_user_data_key_t key {};
+
+	cairo_font_face_t *face = cairo_ft_font_face_create_for_ft_face(ft, 0);
+	if (cairo_font_face_set_user_data(face, &key, ft, done_face) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_font_face_destroy(face);
+		done_face(ft);
+		return false;
+	}
+
+	cairo_font_face_t *old = nullptr;
+
+	for (auto &e : m_faces)
+	{
+		if (e.family == family)
+		{
+			old = e.face;
+			e.face = face;
+			break;
+		}
+	}
+
+	if (!old)
+		m_faces.push_back({family, face});
+	else
+		cairo_font_face_destroy(old);
+
+	return true;
+}
+
+::Cairo::RefPtr<::Cairo::FontFace> font_registry::face(const char *family)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	cairo_font_face_t *face = nullptr;
+
+	for (auto &e : m_faces)
+	{
+		if (e.family == family)
+		{
+			face = e.face;
+			break;
+		}
+	}
+
+	if (!face)
+	{
+		face = cairo_toy_font_face_create(family, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+		m_faces.push_back({family, face});
+	}
+
+	// referenced under the lock, before add_file() can release it
+
+	return ::Cairo::RefPtr<::Cairo::FontFace>(new ::Cairo::FontFace(face, false));
+}
+
+} // abcd
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include <cairomm/cairomm.h>
+
+namespace abcd {
+
+// ---------------------------------------------------------
+// FONT REGISTRY
+// ---------------------------------------------------------
+
+/**
+ * font faces shared by every Draw of the process. Families registered
+ * with add_file() are loaded by FreeType; any other family is resolved
+ * once through cairo's toy font API (and so fontconfig) and then reused.
+ * All methods can be called from any thread
+ */
+
+class font_registry
+{
+	// the C face is kept rather than a cairomm wrapper: the reference
+	// count of a RefPtr is not atomic, that of a cairo_font_face_t is,
+	// so every caller gets a wrapper of its own
+
+	struct entry
+	{
+		std::string family;
+		cairo_font_face_t *face;
+	};
+
+	std::mutex m_mutex;
+	void *m_library {nullptr};	// FT_Library, created on the first add_file()
+
+	// FT_New_Face and FT_Done_Face on m_library; taken without m_mutex
+	// by the destruction of a face, which may happen on any thread
+	std::mutex m_library_mutex;
+
+	static void done_face(void *ft);
+	std::vector<entry> m_faces;
+
+	font_registry() {}
+
+public:
+
+	/**
+	 * the registry of the process, never destroyed: faces handed out
+	 * may outlive static objects
+	 */
+
+	static font_registry &instance();
+
+	/**
+	 * loads face index of the font file at path as family, replacing
+	 * the face that family had for the Draw instances created later;
+	 * returns false when FreeType cannot load the file
+	 */
+
+	bool add_file(const char *family, const char *path, int index = 0);
+
+	/**
+	 * the face of family, created on the first request, in a wrapper
+	 * owned by the caller
+	 */
+
+	::Cairo::RefPtr<::Cairo::FontFace> face(const char *family);
+};
+
+} // abcd
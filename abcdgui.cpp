@@ -22,8 +22,58 @@
 
 #include <algorithm>
 #include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <new>
+#include <mutex>
+#include <condition_variable>
 
 #include "abcdgui.h"
+#include "abcdpixel.h"
+
+#ifdef ABCD_ALLOC_CHECK
+
+// counts every operator new on the calling thread, see window::fail_on_alloc
+
+static thread_local uint64_t g_heap_allocations = 0;
+
+void *operator new(size_t size)
+{
+	++g_heap_allocations;
+	if (void *p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+#endif
+
 
 namespace abcd {
 
@@ -31,12 +81,33 @@ namespace abcd {
 // TODO: review x bearing usage
 
 
+uint64_t heap_allocations()
+{
+#ifdef ABCD_ALLOC_CHECK
+	return g_heap_allocations;
+#else
+	return 0;
+#endif
+}
+
+
 bool contains(const rect &r, point pt)
 {
 	bool b = r.x1 <= pt.x && pt.x < r.x2;
 	return b && r.y1 <= pt.y && pt.y < r.y2;
 }
 
+rect intersection(const rect &a, const rect &b)
+{
+	rect r {std::max(a.x1, b.x1), std::max(a.y1, b.y1), 
+		std::min(a.x2, b.x2), std::min(a.y2, b.y2)};
+
+	if (r.x1 >= r.x2 || r.y1 >= r.y2)
+		return rect();
+
+	return r;
+}
+
 void move(rect &r, int x, int y) 
 { 
 	auto w = r.width(), h = r.height();
@@ -204,767 +275,2628 @@ rect pad(rect r, span h, span v)
 
 
 
+widget_id hash_id(const void *data, size_t length, widget_id seed)
+{
+	// FNV-1a
+
+	uint32_t h = 2166136261u ^ seed;
+	auto p = static_cast<const uint8_t *>(data);
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619u;
+	}
+
+	return h != 0 ? h : 1;
+}
+
 window::window()
 {
+	m_created = std::chrono::steady_clock::now();
 }
 
-void window::begin(Draw *draw)
+window::~window()
 {
-	this->draw = draw;
+	if (m_prewarm.joinable())
+		m_prewarm.join();
 }
 
-void window::end()
+void window::prewarm(slice<font_spec> fonts, std::string_view charset, glyph_atlas *atlas)
 {
-	if (mouse_down && mouse_widget == nullptr)
-		mouse_widget = &background;
+	if (m_prewarm.joinable())
+		m_prewarm.join();
 
-	if (!mouse_down)
-		mouse_widget = nullptr;
+	std::vector<std::pair<std::string, float>> specs;
+	for (auto &f : fonts)
+		specs.emplace_back(f.family, f.size);
 
-	key_down = false;
+	std::string chars;
+	if (charset.empty())
+	{
+		for (char c = 32; c < 127; ++c)
+			chars += c;
+	}
+	else
+		chars = charset;
+
+	m_prewarmed.reset(new Draw(1, 1, 1));
+
+	// text() measures the metrics and the x height and renders every
+	// glyph, into cairo's glyph cache or the atlas; the 1x1 target
+	// keeps the blending cost out
+
+	m_prewarm = std::thread([draw = m_prewarmed.get(), specs, chars, atlas]()
+	{
+		draw->set_glyph_atlas(atlas);
+
+		for (auto &f : specs)
+		{
+			draw->set_font(f.first.c_str(), f.second);
+			draw->text(chars.c_str(), {0, 0, 1, 1}, -1, -1);
+		}
+
+		draw->set_glyph_atlas(nullptr);
+	});
 }
 
-void window::begin_widget(rect &r)
+void window::prewarm(std::string_view charset, glyph_atlas *atlas)
 {
-	draw->push();
-	draw->translate({r.x1, r.y1});
-	move(r, 0, 0);
-	draw->clip(r);
+	prewarm({{m_theme.font_family(), float(m_theme.font_size())}}, charset, atlas);
 }
 
-void window::end_widget()
+void window::begin(Draw *draw)
 {
-	draw->pop();
+	std::chrono::duration<double> now = std::chrono::steady_clock::now() - m_created;
+	begin(draw, now.count());
 }
 
-// ----------------------------------------------------------------------------
-// PANEL
-// ----------------------------------------------------------------------------
-
-abcd::rect begin_panel(window *win, panel_widget *id, abcd::rect r)
+void window::begin(Draw *draw, double time)
 {
-	id->r = r;
-	win->begin_widget(r);
+	ABCD_PROFILE_FRAME();
+	ABCD_PROFILE_BEGIN("frame", nullptr, this);
+	ABCD_PROFILE_FUNCTION();
 
-	win->mouse_x -= id->r.x1;
-	win->mouse_y -= id->r.y1;
+	if (m_prewarm.joinable())
+	{
+		m_prewarm.join();
+		draw->adopt_fonts(*m_prewarmed);
+		for (auto &l : m_layers)
+			if (l.draw)
+				l.draw->adopt_fonts(*m_prewarmed);
+		m_prewarmed.reset();
+	}
 
-	return r;
-}
+	m_target = draw;
+	if (!m_layers.empty())
+		draw = begin_layers(draw);
 
-rect end_panel(window *win, panel_widget *id)
-{
-	win->end_widget();
-	win->mouse_x += id->r.x1;
-	win->mouse_y += id->r.y1;
+	this->draw = draw;
+	m_id_stack.clear();
+	arena.reset();
 
-	return id->r;
-}
+	m_origin = {0, 0};
+	m_clip = {0, 0, draw->width(), draw->height()};
 
-// ----------------------------------------------------------------------------
-// LABEL
-// ----------------------------------------------------------------------------
+	apply_events();
 
-void label(window *win, widget *id, abcd::rect r, std::string text, int xa, int ya)
-{
-	win->begin_widget(r);
+	hot_widget = nullptr;
+	hot_item = 0;
 
-	auto &t = win->m_theme;
-	win->draw->set_font(t.font_family(), t.font_size());
+	if (auto h = m_hits.find({mouse_x, mouse_y}))
+	{
+		hot_widget = h->id;
+		hot_item = h->item;
+	}
 
-	win->draw->set_solid_paint(win->m_theme.text());
-	win->draw->text(text.c_str(), r, xa, ya);
+	m_allocs_at_begin = heap_allocations();
 
-	win->end_widget();
-}
+	m_frame = draw_counters();
+	m_frame_start = std::chrono::steady_clock::now();
 
-// ----------------------------------------------------------------------------
-// BUTTON
-// ----------------------------------------------------------------------------
+	clock.delta = clock.frame ? time - clock.now : 0;
+	clock.now = time;
+	++clock.frame;
+	m_wake = HUGE_VAL;
+}
 
-bool button(window *win, widget *id, abcd::rect r, std::string text)
+void window::end()
 {
-	bool clicked = 0;
+	ABCD_PROFILE_BEGIN("end", nullptr, nullptr);
 
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	if (mouse_down && mouse_widget == nullptr)
+		mouse_widget = &background;
 
-	win->begin_widget(r);
+	if (!mouse_down)
+		mouse_widget = nullptr;
 
-	if (contains(r, mouse))
-	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-			}
-		}
-		else
-		{
-			if (!win->mouse_down && win->mouse_widget == id)
-			{
-				win->mouse_widget = nullptr;
-				clicked = true;
-			}
-		}
-	}
+	key_down = false;
+	key_utf8.clear();
+	mouse_pressed = false;
+	mouse_released = false;
 
-	bool held = win->mouse_down && win->mouse_widget == id;
+	m_hits.build();
 
+	m_states.sweep([this](widget *w)
+	{
+		if (mouse_widget == w)
+			mouse_widget = nullptr;
+		if (focus_widget == w)
+			focus_widget = nullptr;
+	});
 
-	auto &t = win->m_theme;
-	win->draw->set_font(t.font_family(), t.font_size());
+	if (!m_layers.empty())
+		composite();
 
-	if (held)
-	{
-		win->draw->set_solid_paint(win->m_theme.fore());
-		win->draw->stroke_rounded_rectangle(r, 4, 4);
+	frame_allocs = heap_allocations() - m_allocs_at_begin;
 
-		win->draw->set_solid_paint(win->m_theme.text());
-		win->draw->text(text.c_str(), r, 0, 0);
-	}
-	else
+	if (fail_on_alloc && frame_allocs > 0)
 	{
-		win->draw->set_solid_paint(win->m_theme.fore());
-		win->draw->fill_rounded_rectangle(r, 4, 4);
+		fprintf(stderr, "abcd: %u heap allocations in a steady-state frame\n", frame_allocs);
+		abort();
+	}
 
-		win->draw->set_solid_paint(win->m_theme.text());
-		win->draw->text(text.c_str(), r, 0, 0);
+	auto d = draw_counters();
+	auto &c = stats.last;
+	c = m_frame;
+	c.draw_calls = d.draw_calls - m_frame.draw_calls;
+	c.font_hits = d.font_hits - m_frame.font_hits;
+	c.font_misses = d.font_misses - m_frame.font_misses;
+	c.layout_hits = layout_hits - m_frame.layout_hits;
+	c.layout_misses = layout_misses - m_frame.layout_misses;
+	c.allocations = frame_allocs;
+
+	std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now() - m_frame_start;
+	if (stats.frames == 0)
+	{
+		std::chrono::duration<float, std::milli> first = std::chrono::steady_clock::now() - m_created;
+		stats.first_frame_ms = first.count();
 	}
 
-	win->end_widget();
+	stats.frame_ms[stats.frames % frame_stats::history] = ms.count();
+	++stats.frames;
 
-	return clicked;
+	ABCD_PROFILE_END();	// end
+	ABCD_PROFILE_END();	// frame
 }
 
-// ----------------------------------------------------------------------------
-// CHECK BUTTON
-// ----------------------------------------------------------------------------
-
-bool checkbutton(window *win, widget *id, abcd::rect r, bool *value)
+void window::apply_events()
 {
-	bool clicked = false;
-
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	size_t i = 0;
 
-	win->begin_widget(r);
+	pointer_samples.clear();
 
-	if (contains(r, mouse))
+	for (; i < events.size(); ++i)
 	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-			}
-		}
-		else
+		auto &e = events[i];
+
+		// a frame sees at most one press and one release, in this order;
+		// the rest waits for the next frame
+
+		if (e.type == input_event::press && (mouse_pressed || mouse_released))
+			break;
+		if (e.type == input_event::release && mouse_released)
+			break;
+
+		switch (e.type)
 		{
-			if (!win->mouse_down && win->mouse_widget == id)
+			case input_event::motion:
 			{
-				win->mouse_widget = nullptr;
-				clicked = true;
-				*value = !*value;
+				auto samples = events.samples(e);
+				pointer_samples.insert(pointer_samples.end(), samples.begin(), samples.end());
+				mouse_x = e.x;
+				mouse_y = e.y;
+				break;
 			}
+
+			case input_event::press:
+				pointer_samples.push_back({e.x, e.y, e.time});
+				mouse_x = e.x;
+				mouse_y = e.y;
+				mouse_button = e.button;
+				mouse_down = true;
+				mouse_pressed = true;
+				break;
+
+			case input_event::release:
+				pointer_samples.push_back({e.x, e.y, e.time});
+				mouse_x = e.x;
+				mouse_y = e.y;
+				mouse_down = false;
+				mouse_released = true;
+				break;
+
+			case input_event::text:
+				key_utf8.append(events.text(e));
+				key_down = true;
+				break;
 		}
+
+		event_time = e.time;
 	}
 
-	int a;
-	abcd::rect ri;
+	events.consume(i);
+}
 
-	if (r.width() > r.height())
+rect window::to_window(rect r)
+{
+	move(r, r.x1 + m_origin.x, r.y1 + m_origin.y);
+	return r;
+}
+
+bool window::hit(widget *id, rect r, uint32_t item)
+{
+	m_hits.add(id, item, intersection(m_clip, to_window(r)));
+	return hot_widget == id && hot_item == item;
+}
+
+int window::pointer(widget *id, rect r, uint32_t item)
+{
+	if (!hit(id, r, item))
+		return 0;
+
+	int flags = pointer_hot;
+
+	if (mouse_widget == nullptr && (mouse_down || mouse_pressed))
 	{
-		a = r.height();
-		int radius = a * 0.8 / 2;
-		int b = (a - radius*2) / 2; 
-		int x1 = r.x1 + (!*value ? b : r.width() - b - 2 * radius);
-		int y1 = r.y1 + b;
-		ri = {x1, y1, x1 + 2*radius, y1 + 2*radius};
+		mouse_widget = id;
+		flags |= pointer_pressed;
 	}
-	else
+
+	// not else: a press and a release can both be queued for the same frame
+
+	if (!mouse_down && mouse_widget == id)
 	{
-		a = r.width();
-		int radius = a * 0.8 / 2;
-		int b = (a - radius*2) / 2; 
-		int x1 = r.x1 + b;
-		int y1 = r.y1 + (!*value ? b : r.height() - b - 2 * radius);
-		ri = {x1, y1, x1 + 2*radius, y1 + 2*radius};
+		mouse_widget = nullptr;
+		flags |= pointer_released;
 	}
 
-	win->draw->set_solid_paint(win->m_theme.back());
-	win->draw->fill_rounded_rectangle(r, a/2, a/2);
+	return flags;
+}
 
-	win->draw->set_solid_paint(win->m_theme.fore());
-	win->draw->fill_arc(ri, 0, 360);
+void window::push_id(const char *str)
+{
+	m_id_stack.push_back(get_id(str));
+}
 
+void window::push_id(int n)
+{
+	m_id_stack.push_back(get_id(n));
+}
 
+void window::pop_id()
+{
+	if (!m_id_stack.empty())
+		m_id_stack.pop_back();
+}
 
-	win->end_widget();
+widget_id window::get_id(const char *str)
+{
+	widget_id seed = m_id_stack.empty() ? 0 : m_id_stack.back();
+	return hash_id(str, strlen(str), seed);
+}
 
-	return clicked;
+widget_id window::get_id(int n)
+{
+	widget_id seed = m_id_stack.empty() ? 0 : m_id_stack.back();
+	return hash_id(&n, sizeof(n), seed);
+}
+
+void window::begin_widget(rect &r, const char *kind, const widget *id)
+{
+	// the scope covers the widget drawing, up to end_widget()
+
+	ABCD_PROFILE_BEGIN(kind ? kind : "widget", 
+		id && !id->name.empty() ? id->name.c_str() : nullptr, id);
+
+	++m_frame.widgets;
+	if (intersection(m_clip, to_window(r)).width() == 0)
+		++m_frame.clipped;
+
+	draw->push();
+	draw->translate({r.x1, r.y1});
+	move(r, 0, 0);
+	draw->clip(r);
+}
+
+void window::end_widget()
+{
+	draw->pop();
+
+	ABCD_PROFILE_END();
+}
+
+bool window::cull(rect r)
+{
+	if (intersection(m_clip, to_window(r)).width() != 0)
+		return false;
+
+	++m_frame.culled;
+	return true;
 }
 
 // ----------------------------------------------------------------------------
-// RADIO BUTTON
+// ANIMATION
 // ----------------------------------------------------------------------------
 
-bool radiobutton(window *win, widget *id, abcd::rect r, int index, int *value)
+float window::animate(widget_id id, float target, float duration, easing curve)
 {
-	int clicked = 0;
+	auto a = m_states.get<animation_state>(id);
 
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	if (!a->started)
+	{
+		a->started = true;
+		a->from = a->to = a->value = target;
+		a->start = a->end = clock.now;
+	}
 
-	win->begin_widget(r);
+	if (target != a->to)
+	{
+		a->from = a->value;
+		a->to = target;
+		a->start = clock.now;
+		a->end = clock.now + std::max(0.f, duration);
+		a->curve = curve;
+	}
 
-	if (contains(r, mouse))
+	if (clock.now >= a->end)
 	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-			}
-		}
-		else
-		{
-			if (!win->mouse_down && win->mouse_widget == id)
-			{
-				win->mouse_widget = nullptr;
-				clicked = 1;
-			}
-		}
+		a->value = a->to;
+		return a->value;
 	}
 
-	bool changed = false;
+	float t = (clock.now - a->start) / (a->end - a->start);
 
-	if (clicked)
+	switch (a->curve)
 	{
-		changed = (*value != index);
-		*value = index;
-	}
+		case easing::linear:
+			break;
 
+		case easing::out:
+			t = 1 - (1 - t) * (1 - t) * (1 - t);
+			break;
 
-	auto &t = win->m_theme;
-	win->draw->set_font(t.font_family(), t.font_size());
+		case easing::in_out:
+			t = t * t * (3 - 2 * t);
+			break;
+	}
 
-	int size = std::min(r.width(), r.height());
-	r = adjust(r, size, size);
+	a->value = a->from + (a->to - a->from) * t;
+	++m_frame.animations;
 
-	win->draw->set_solid_paint(win->m_theme.back());
-	win->draw->fill_arc(r, 0, 360);
+	return a->value;
+}
 
-	if (*value == index)
-	{
-		inflate(r, -1, -1);
-		win->draw->set_solid_paint(win->m_theme.fore());
-		win->draw->fill_arc(r, 0, 360);
-	}
+float window::animate(const char *name, float target, float duration, easing curve)
+{
+	return animate(get_id(name), target, duration, curve);
+}
 
-	win->end_widget();
+void window::wake_at(double time)
+{
+	m_wake = std::min(m_wake, time);
+}
 
-	return changed;
+double window::next_deadline() const
+{
+	if (!events.empty())
+		return clock.now;
+
+	double deadline = m_wake;
+
+	// paced to the display: one period after the frame just drawn
+
+	if (stats.last.animations)
+		deadline = std::min(deadline, clock.now + clock.period);
+
+	return deadline;
 }
 
 // ----------------------------------------------------------------------------
-// SLIDER
+// LAYERS
 // ----------------------------------------------------------------------------
 
-bool slider(window *win, slider_widget *id, abcd::rect r, int thumbsize, float *value, bool horz)
+static bool empty(const rect &r)
 {
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	return r.width() <= 0 || r.height() <= 0;
+}
+
+static rect bounding(const rect &a, const rect &b)
+{
+	if (empty(a))
+		return b;
+	if (empty(b))
+		return a;
+
+	return {std::min(a.x1, b.x1), std::min(a.y1, b.y1), 
+		std::max(a.x2, b.x2), std::max(a.y2, b.y2)};
+}
 
-	win->begin_widget(r);
+void window::set_layers(int count)
+{
+	m_layers.resize(std::max(0, count));
+	m_recomposite = true;
+}
 
-	bool pressed = false;
+Draw *window::begin_layers(Draw *target)
+{
+	int w = target->width();
+	int h = target->height();
 
-	if (contains(r, mouse))
+	for (auto &l : m_layers)
 	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-				pressed = true;
-			}
-		}
-		else
+		if (!l.draw || l.draw->width() != w || l.draw->height() != h)
 		{
-			if (!win->mouse_down && win->mouse_widget == id)
-			{
-				win->mouse_widget = nullptr;
-			}
+			l.draw.reset(new Draw(w, h, 1));
+			l.draw->adopt_fonts(*target);
+			l.draw->set_glyph_atlas(target->get_glyph_atlas());
+			l.list.reset();
+			l.previous.clear();
+			l.drawn = {};
+			m_recomposite = true;
 		}
-	}
 
-	float v = *value;
-	v = std::max(0.f, v);
-	v = std::min(1.f, v);
+		l.list.begin_frame();
+		l.draw->record(&l.list, false);
+		l.bounds = {};
+	}
 
-	auto thumb = r;
+	m_layers[0].bounds = {0, 0, w, h};
+	m_layer = 0;
+	m_layer_stack.clear();
 
-	int tracklen;
-	int z;
-	
-	int *thumb_z1;
-	int *thumb_z2;
-	int mouse_z;
-	int r_z1;
-	int r_z2;
-	int extent;
+	return m_layers[0].draw.get();
+}
 
-	if (horz)
-	{
-		thumb_z1 = &thumb.x1;
-		thumb_z2 = &thumb.x2;
-		mouse_z = mouse.x;
-		r_z1 = r.x1;
-		r_z2 = r.x2;
-		extent = r.width();
-	}
-	else
+void window::begin_layer(int index, rect r)
+{
+	if (index <= 0 || index >= int(m_layers.size()))
 	{
-		thumb_z1 = &thumb.y1;
-		thumb_z2 = &thumb.y2;
-		mouse_z = mouse.y;
-		r_z1 = r.y1;
-		r_z2 = r.y2;
-		extent = r.height();
+		m_layer_stack.push_back(-1);
+		return;
 	}
 
+	m_layer_stack.push_back(m_layer);
+	m_layer = index;
 
-	thumbsize = std::min(extent, thumbsize);
-	tracklen = extent - thumbsize;
+	auto &l = m_layers[index];
+	rect area = intersection({0, 0, m_target->width(), m_target->height()}, to_window(r));
+	l.bounds = bounding(l.bounds, area);
 
-	v = std::max(0.f, v);
-	v = std::min(1.f, v);
+	draw = l.draw.get();
+	draw->push();
+	draw->translate(m_origin);
+	draw->clip(r);
+}
 
-	z = v * tracklen;
+void window::end_layer()
+{
+	if (m_layer_stack.empty())
+		return;
 
-	*thumb_z1 = z;
-	*thumb_z2 = z + thumbsize;
+	int parent = m_layer_stack.back();
+	m_layer_stack.pop_back();
 
-	if (pressed)
+	if (parent < 0)
+		return;
+
+	draw->pop();
+	m_layer = parent;
+	draw = m_layers[parent].draw.get();
+}
+
+void window::composite()
+{
+	ABCD_PROFILE_FUNCTION();
+
+	int w = m_target->width();
+	int h = m_target->height();
+
+	rect changed = m_recomposite ? rect(0, 0, w, h) : rect();
+	m_recomposite = false;
+
+	// layers whose calls changed are rasterized again from their list
+
+	for (auto &l : m_layers)
 	{
-		id->delta = mouse_z - *thumb_z1;
+		l.draw->record(nullptr);
 
-		if (id->delta < 0)
-		{
-			// BEFORE THUMB
+		bool same = l.list.size() == l.previous.size() 
+			&& memcmp(l.list.data(), l.previous.data(), l.previous.size()) == 0;
 
-			id->delta = thumbsize / 2;
-			*thumb_z1 = mouse_z - id->delta;
-			*thumb_z2 = *thumb_z1 + thumbsize;
+		if (same && !l.previous.empty() && l.bounds.x1 == l.drawn.x1 && l.bounds.y1 == l.drawn.y1
+			&& l.bounds.x2 == l.drawn.x2 && l.bounds.y2 == l.drawn.y2)
+			continue;
 
-			if (thumb_z1 < 0)
-			{
-				id->delta = mouse_z - r_z1;
-				*thumb_z1 = mouse_z - id->delta;
-				*thumb_z2 = *thumb_z1 + thumbsize;
-			}
+		rect area = bounding(l.bounds, l.drawn);
 
-			v = float(*thumb_z1) / tracklen;
-		}
-		else if (id->delta >= thumbsize)
+		if (!empty(area))
 		{
-			// AFTER THUMB
+			l.draw->flush();
+			uint8_t *p = l.draw->pixels() + size_t(area.y1) * l.draw->stride() + area.x1 * 4;
+			for (int y = area.y1; y < area.y2; ++y, p += l.draw->stride())
+				memset(p, 0, area.width() * 4);
+			l.draw->mark_dirty(area);
+		}
 
-			id->delta = thumbsize / 2;
-			*thumb_z1 = mouse_z - id->delta;
-			*thumb_z2 = *thumb_z1 + thumbsize;
+		// the fonts were looked up once already while recording
 
-			if (*thumb_z2 > r_z2)
-			{
-				id->delta = thumbsize - (r_z2 - mouse_z);
-				*thumb_z1 = mouse_z - id->delta;
-				*thumb_z2 = *thumb_z1 + thumbsize;
-			}
+		uint32_t hits = l.draw->font_hits;
+		uint32_t misses = l.draw->font_misses;
 
-			v = float(*thumb_z1) / tracklen;
-		}
+		l.player.play(l.list.data(), l.list.size(), l.draw.get());
+		l.draw->flush();
+
+		l.draw->font_hits = hits;
+		l.draw->font_misses = misses;
+
+		l.previous.assign(l.list.data(), l.list.data() + l.list.size());
+		l.drawn = l.bounds;
+		changed = bounding(changed, area);
 	}
-	else
+
+	// every buffer misses what changed, the one given to begin() gets
+	// all it missed; one not seen before holds nothing of ours
+
+	layer_target *target = nullptr;
+
+	for (auto &t : m_targets)
 	{
-		if (win->mouse_widget == id)
-		{
-			z = std::min(tracklen, mouse_z - id->delta);
-			z = std::max(0, z);
+		t.damage = bounding(t.damage, changed);
+		if (t.pixels == m_target->pixels())
+			target = &t;
+	}
 
-			*thumb_z1 = z;
-			*thumb_z2 = z + thumbsize;
+	if (!target)
+	{
+		if (m_targets.size() >= 8)
+			m_targets.erase(std::min_element(m_targets.begin(), m_targets.end(), 
+				[](const layer_target &a, const layer_target &b) { return a.frame < b.frame; }));
 
-			v = float(z) / tracklen;
-		}
+		m_targets.push_back({m_target->pixels(), rect(0, 0, w, h), 0});
+		target = &m_targets.back();
 	}
 
-	win->draw->set_solid_paint(win->m_theme.back());
-	win->draw->fill_rounded_rectangle(r, 3, 3);	
+	damage = target->damage;
+	target->damage = {};
+	target->frame = clock.frame;
 
-	win->draw->set_solid_paint(win->m_theme.fore());
-	win->draw->fill_rounded_rectangle(thumb, 3, 3);
+	m_layer = 0;
+	m_layer_stack.clear();
+	draw = m_target;
 
-	win->end_widget();
+	if (empty(damage))
+		return;
 
-	bool changed = v != *value;
-	*value = v;	
-	return changed;
-}
+	// the base is copied, the layers above blended over it
 
-// ----------------------------------------------------------------------------
-// KNOB
-// ----------------------------------------------------------------------------
+	m_target->flush();
 
-bool knob(window *win, knob_widget *id, abcd::rect r, float *value)
+	int stride = m_target->stride();
+	uint8_t *dst = m_target->pixels();
+
+	for (size_t i = 0; i < m_layers.size(); ++i)
+	{
+		auto &l = m_layers[i];
+		rect r = i == 0 ? damage : intersection(l.drawn, damage);
+		if (empty(r))
+			continue;
+
+		int ls = l.draw->stride();
+		const uint8_t *src = l.draw->pixels();
+
+		for (int y = r.y1; y < r.y2; ++y)
+		{
+			uint32_t *d = (uint32_t *)(dst + size_t(y) * stride) + r.x1;
+			const uint32_t *s = (const uint32_t *)(src + size_t(y) * ls) + r.x1;
+
+			if (i == 0)
+				memcpy(d, s, r.width() * 4);
+			else
+				over_pixels(d, s, r.width());
+		}
+	}
+
+	m_target->mark_dirty(damage);
+}
+
+frame_stats::counters window::draw_counters()
 {
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	frame_stats::counters c;
 
-	win->begin_widget(r);
+	c.draw_calls = m_target->draw_calls;
+	c.font_hits = m_target->font_hits;
+	c.font_misses = m_target->font_misses;
 
-	float v = *value;
-	v = std::max(0.f, v);
-	v = std::min(1.f, v);
-	v = v * 270;
+	for (auto &l : m_layers)
+	{
+		if (!l.draw)
+			continue;
 
-	id->angle = v;
+		c.draw_calls += l.draw->draw_calls;
+		c.font_hits += l.draw->font_hits;
+		c.font_misses += l.draw->font_misses;
+	}
 
-	auto knob = r;
+	c.layout_hits = layout_hits;
+	c.layout_misses = layout_misses;
 
-	int extent = r.width() < r.height() ? r.width() : r.height();
-	
-	knob.x1 = r.width() / 2 - extent / 2;
-	knob.y1 = r.height() / 2 - extent / 2;
-	knob.x2 = knob.x1 + extent;
-	knob.y2 = knob.y1 + extent;
+	return c;
+}
 
+// ----------------------------------------------------------------------------
+// EVENT QUEUE
+// ----------------------------------------------------------------------------
 
-	bool pressed = false;
+void event_queue::motion(int x, int y, double time)
+{
+	m_samples.push_back({x, y, time});
 
-	if (contains(knob, mouse))
+	if (!m_events.empty() && m_events.back().type == input_event::motion)
 	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-				pressed = true;
-			}
-		}
-		else
-		{
-			if (!win->mouse_down && win->mouse_widget == id)
-			{
-				win->mouse_widget = nullptr;
-			}
-		}
+		auto &e = m_events.back();
+		e.x = x;
+		e.y = y;
+		e.time = time;
+		++e.length;
+		return;
 	}
 
+	m_events.push_back({input_event::motion, 0, x, y, time, uint32_t(m_samples.size() - 1), 1});
+}
 
-	int xc = r.width() / 2;
-	int yc = r.height() / 2;
+void event_queue::press(uint32_t button, int x, int y, double time)
+{
+	m_events.push_back({input_event::press, uint8_t(button), x, y, time, 0, 0});
+}
 
-	if (pressed) 
+void event_queue::release(uint32_t button, int x, int y, double time)
+{
+	m_events.push_back({input_event::release, uint8_t(button), x, y, time, 0, 0});
+}
+
+void event_queue::text(std::string_view utf8, double time)
+{
+	if (!m_events.empty() && m_events.back().type == input_event::text)
 	{
-		id->x1 = mouse.x - xc;
-		id->y1 = mouse.y - yc;
+		auto &e = m_events.back();
+		m_text.append(utf8);
+		e.length += utf8.size();
+		e.time = time;
+		return;
 	}
-	else if (win->mouse_widget == id)
+
+	m_events.push_back({input_event::text, 0, 0, 0, time, uint32_t(m_text.size()), uint32_t(utf8.size())});
+	m_text.append(utf8);
+}
+
+void event_queue::consume(size_t n)
+{
+	if (n >= m_events.size())
 	{
-		float x2 = mouse.x - xc;
-		float y2 = mouse.y - yc;
+		m_events.clear();
+		m_text.clear();
+		m_samples.clear();
+		return;
+	}
 
-		if (x2 != id->x1 || y2 != id->y1)
-		{
-			float v1 = sqrt(id->x1 * id->x1 + id->y1 * id->y1);
-			float v2 = sqrt(x2 * x2 + y2 * y2);
+	m_events.erase(m_events.begin(), m_events.begin() + n);
 
-			float dir = asin((id->x1 * y2 - x2 * id->y1) / (v1 * v2))* 180 / M_PI;
-			float delta = acos((id->x1 * x2 + id->y1 * y2) / (v1 * v2)) * 180 / M_PI;
+	// text and samples go in the order of their events: what comes
+	// before the first left is consumed
 
-			id->x1 = x2;
-			id->y1 = y2;
+	uint32_t text = m_text.size();
+	uint32_t samples = m_samples.size();
 
-			id->angle += dir > 0 ? delta : -delta;
+	for (auto &e : m_events)
+	{
+		if (e.type == input_event::text)
+			text = std::min(text, e.offset);
+		else if (e.type == input_event::motion)
+			samples = std::min(samples, e.offset);
+	}
 
-			id->angle = std::max(0.f, id->angle);
-			id->angle = std::min(270.f, id->angle);
+	m_text.erase(0, text);
+	m_samples.erase(m_samples.begin(), m_samples.begin() + samples);
 
-			v = id->angle;
-		}
+	for (auto &e : m_events)
+	{
+		if (e.type == input_event::text)
+			e.offset -= text;
+		else if (e.type == input_event::motion)
+			e.offset -= samples;
 	}
+}
 
-	win->draw->set_solid_paint(win->m_theme.fore());
-	win->draw->fill_arc(knob, 0, 360);
+// ----------------------------------------------------------------------------
+// TEXT LAYOUT
+// ----------------------------------------------------------------------------
 
+int text_layout::word_width(Draw *draw, widget_id font, std::string_view word)
+{
+	if (word.empty())
+		return 0;
 
-	win->draw->push();
-	win->draw->translate({xc, yc});
-	win->draw->rotate(id->angle+135);
-	rect index {int(extent * 0.24), -2, int(extent * 0.45), 2};
-	win->draw->set_solid_paint(win->m_theme.text());
-	win->draw->fill_rectangle(index);
-	win->draw->pop();
+	widget_id key = hash_id(word.data(), word.size(), font);
 
-	win->end_widget();
+	auto it = m_words.find(key);
+	if (it != m_words.end() && it->second.font == font && it->second.text == word)
+		return it->second.width;
 
-	v = v / 270.f;
+	if (m_words.size() >= max_words)
+		m_words.clear();
 
+	m_word.assign(word);
+	int w = draw->get_textline_size(m_word.c_str()).width;
 
+	auto &e = m_words[key];
+	e.font = font;
+	e.text = m_word;
+	e.width = w;
 
-	bool changed = v != *value;
-	*value = v;	
-	return changed;
+	return w;
 }
 
+void text_layout::wrap(Draw *draw, widget_id font, std::string_view text, int width, paragraph &p)
+{
+	++wraps;
 
-// ----------------------------------------------------------------------------
-// INPUT
-// ----------------------------------------------------------------------------
+	// greedy breaks; the first word of a line is always placed, so only
+	// lines of two words or more bound the width from below, and each
+	// break bounds it from above by the width that would have avoided it
 
-bool input(window *win, widget *id, abcd::rect r, std::string& value)
-{
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	int space = word_width(draw, font, " ");
 
-	win->begin_widget(r);
+	p.lines.clear();
+	p.min_width = 0;
+	p.max_width = INT_MAX;
 
+	line cur {0, 0};
+	int cur_width = 0;
+	bool cur_multi = false;
+	bool cur_empty = true;
+	size_t pos = 0;
 
-	if (contains(r, mouse))
+	while (true)
 	{
-		if (win->mouse_widget == nullptr)
+		size_t end = text.find(' ', pos);
+		if (end == std::string_view::npos)
+			end = text.size();
+
+		int w = word_width(draw, font, text.substr(pos, end - pos));
+
+		if (cur_empty)
 		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-				win->focus_widget = id;
-			}
+			cur = {uint32_t(pos), uint32_t(end)};
+			cur_width = w;
+			cur_empty = false;
+		}
+		else if (cur_width + space + w <= width)
+		{
+			cur.end = end;
+			cur_width += space + w;
+			cur_multi = true;
 		}
 		else
 		{
-			if (!win->mouse_down && win->mouse_widget == id)
-			{
-				win->mouse_widget = nullptr;
-			}
+			p.max_width = std::min(p.max_width, cur_width + space + w);
+			if (cur_multi)
+				p.min_width = std::max(p.min_width, cur_width);
+
+			p.lines.push_back(cur);
+			cur = {uint32_t(pos), uint32_t(end)};
+			cur_width = w;
+			cur_multi = false;
 		}
-	}
 
-	bool enter = false;
-
-	if (win->focus_widget == id && win->key_down)
-	{
-		if (win->key_utf8[0] > 31)
-			value = value + win->key_utf8;
-		else if (win->key_utf8[0] == 8)
-			value = value.substr(0, value.length()  - 1);
-		else if (win->key_utf8[0] == 13)
-			enter = true;
+		if (end == text.size())
+			break;
 
-//		printf("CHAR %s\n", win->key_utf8.c_str());
+		pos = end + 1;
 	}
 
-	auto &t = win->m_theme;
-	win->draw->set_font(t.font_family(), t.font_size());
+	if (cur_multi)
+		p.min_width = std::max(p.min_width, cur_width);
 
+	p.lines.push_back(cur);
+}
 
-	win->draw->set_solid_paint(win->m_theme.back());
+slice<text_layout::line> text_layout::layout(Draw *draw, const char *family, float size, 
+	std::string_view text, int width)
+{
+	draw->set_font(family, size);
 
+	widget_id font = hash_id(family, strlen(family), 0);
+	font = hash_id(&size, sizeof(size), font);
 
-	win->draw->fill_rectangle(r);
+	m_lines.clear();
 
+	if (m_paragraphs.size() >= max_paragraphs)
+		m_paragraphs.clear();
 
-	auto s = value.c_str();
-	size m {0, 0};
-	size_t i = 0;
-	while (i < value.size())
+	size_t pos = 0;
+
+	while (true)
 	{
-		m = win->draw->get_textline_size(s + i);
-		if (m.width < r.width()) break;
-		++i;
-	}
+		size_t end = text.find('\n', pos);
+		if (end == std::string_view::npos)
+			end = text.size();
 
-	rect crsr {m.width, 0, m.width + 1, r.height()};
+		auto str = text.substr(pos, end - pos);
+		auto &p = m_paragraphs[hash_id(str.data(), str.size(), font)];
 
-	win->draw->set_stroke_width(1);
+		if (p.font != font || p.text != str)
+		{
+			p.font = font;
+			p.text.assign(str);
+			p.lines.clear();
+		}
 
-	win->draw->set_solid_paint(win->m_theme.text());
-	win->draw->draw_textline(value.substr(i).c_str(), {0, 0});
+		if (p.lines.empty() || width < p.min_width || width >= p.max_width)
+			wrap(draw, font, str, width, p);
 
-	if (win->focus_widget == id)
-		win->draw->fill_rectangle(crsr);
+		for (auto l : p.lines)
+			m_lines.push_back({uint32_t(pos + l.begin), uint32_t(pos + l.end)});
 
-	win->end_widget();
+		if (end == text.size())
+			break;
 
-	return enter;
+		pos = end + 1;
+	}
+
+	return m_lines;
 }
 
 // ----------------------------------------------------------------------------
-// LIST
+// HIT INDEX
 // ----------------------------------------------------------------------------
 
-bool list(window *win, list_widget *id, abcd::rect r, const std::vector<std::string> &items, int &value)
+void hit_index::add(widget *id, uint32_t item, rect r)
 {
-	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+	if (r.width() > 0 && r.height() > 0)
+		m_records.push_back({id, item, r});
+}
 
-	win->begin_widget(r);
+void hit_index::build()
+{
+	m_frame.swap(m_records);
+	m_records.clear();
 
-	enum btn_action {none, pressed, released};
+	m_cols = m_rows = 0;
+	m_cells.clear();
+	m_offsets.clear();
 
-	btn_action btn = none;
+	if (m_frame.empty())
+		return;
 
-	if (contains(r, mouse))
+	m_bounds = m_frame[0].r;
+	for (auto &h : m_frame)
 	{
-		if (win->mouse_widget == nullptr)
-		{
-			if (win->mouse_down)
-			{
-				win->mouse_widget = id;
-				win->focus_widget = id;
-				btn = pressed;
-			}
-		}
-		else
+		m_bounds.x1 = std::min(m_bounds.x1, h.r.x1);
+		m_bounds.y1 = std::min(m_bounds.y1, h.r.y1);
+		m_bounds.x2 = std::max(m_bounds.x2, h.r.x2);
+		m_bounds.y2 = std::max(m_bounds.y2, h.r.y2);
+	}
+
+	m_cols = (m_bounds.width() + cell_size - 1) / cell_size;
+	m_rows = (m_bounds.height() + cell_size - 1) / cell_size;
+
+	// counting sort of the records into the cells they overlap, keeping
+	// the drawing order inside each cell
+
+	m_offsets.assign(m_cols * m_rows + 1, 0);
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (uint32_t i = 0; i < m_frame.size(); ++i)
 		{
-			if (!win->mouse_down && win->mouse_widget == id)
+			rect &r = m_frame[i].r;
+			int c1 = (r.x1 - m_bounds.x1) / cell_size;
+			int c2 = (r.x2 - 1 - m_bounds.x1) / cell_size;
+			int r1 = (r.y1 - m_bounds.y1) / cell_size;
+			int r2 = (r.y2 - 1 - m_bounds.y1) / cell_size;
+
+			for (int y = r1; y <= r2; ++y)
 			{
-				win->mouse_widget = nullptr;
-				btn = released;
+				for (int x = c1; x <= c2; ++x)
+				{
+					if (pass == 0)
+						++m_offsets[y * m_cols + x + 1];
+					else
+						m_cells[m_cursor[y * m_cols + x]++] = i;
+				}
 			}
 		}
-	}
 
-	else
-	{
-		if (!win->mouse_down && win->mouse_widget == id)
+		if (pass == 0)
 		{
-			win->mouse_widget = nullptr;
-			btn = released;
+			for (size_t c = 1; c < m_offsets.size(); ++c)
+				m_offsets[c] += m_offsets[c - 1];
+
+			m_cells.resize(m_offsets.back());
+			m_cursor.assign(m_offsets.begin(), m_offsets.end() - 1);
 		}
 	}
+}
 
-	auto &t = win->m_theme;
-	win->draw->set_font(t.font_family(), t.font_size());
-	float height = win->draw->get_font_height();
+const hit_index::record *hit_index::find(point pt)
+{
+	if (m_cols == 0 || !contains(m_bounds, pt))
+		return nullptr;
 
-	int view = ceil(r.height() / float(height)); 
-	int doc = int(items.size())+1;
-	int vbar = r.height();
-	int nd, ns;
-	float ratio;
+	int c = (pt.x - m_bounds.x1) / cell_size;
+	int r = (pt.y - m_bounds.y1) / cell_size;
+	uint32_t cell = r * m_cols + c;
 
-	rect thumb_rect, scr;
+	// the last one drawn is on top
 
-	bool vbar_visible = doc > view;
+	for (uint32_t i = m_offsets[cell + 1]; i > m_offsets[cell]; --i)
+	{
+		auto &h = m_frame[m_cells[i - 1]];
+		if (contains(h.r, pt))
+			return &h;
+	}
+
+	return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+// LAYOUT CACHE
+// ----------------------------------------------------------------------------
+
+// the entries are keyed by the id and what the edges depend on, and
+// never change once computed: a box keeps a pointer to them for the
+// frame, even when the same id is laid out again with other cells
+
+static widget_id layout_key(widget_id id, uint32_t kind, int length, const void *data, size_t size)
+{
+	widget_id key = hash_id(&kind, sizeof(kind), id);
+	key = hash_id(&length, sizeof(length), key);
+	return hash_id(data, size, key);
+}
+
+const int *window::layout(widget_id id, int length, uint32_t cells)
+{
+	auto l = state<layout_widget>(layout_key(id, layout_widget::even, length, &cells, sizeof(cells)));
+
+	if (l->kind == layout_widget::even && l->length == length && l->edges.size() == cells + 1)
+	{
+		++layout_hits;
+		return l->edges.data();
+	}
+
+	++layout_misses;
+
+	// a colliding key: the edges go to the frame arena
+
+	if (l->kind != layout_widget::none)
+	{
+		int *edges = arena.alloc_array<int>(cells + 1);
+		divide(length, cells, edges);
+		return edges;
+	}
+
+	l->kind = layout_widget::even;
+	l->length = length;
+	l->edges.resize(cells + 1);
+	divide(length, cells, l->edges.data());
+
+	return l->edges.data();
+}
+
+const int *window::layout(widget_id id, int length, slice<uint32_t> weight)
+{
+	auto l = state<layout_widget>(layout_key(id, layout_widget::weighted, length, 
+		weight.begin(), weight.size() * sizeof(uint32_t)));
+
+	if (l->kind == layout_widget::weighted && l->length == length
+		&& std::equal(weight.begin(), weight.end(), l->weight.begin(), l->weight.end()))
+	{
+		++layout_hits;
+		return l->edges.data();
+	}
+
+	++layout_misses;
+
+	if (l->kind != layout_widget::none)
+	{
+		int *edges = arena.alloc_array<int>(weight.size() + 1);
+		divide(length, weight.begin(), weight.size(), edges);
+		return edges;
+	}
+
+	l->kind = layout_widget::weighted;
+	l->length = length;
+	l->weight.assign(weight.begin(), weight.end());
+	l->edges.resize(weight.size() + 1);
+	divide(length, weight.begin(), weight.size(), l->edges.data());
+
+	return l->edges.data();
+}
+
+const int *window::layout_fixed(widget_id id, slice<int> extent)
+{
+	auto l = state<layout_widget>(layout_key(id, layout_widget::fixed, 0, 
+		extent.begin(), extent.size() * sizeof(int)));
+
+	if (l->kind == layout_widget::fixed
+		&& std::equal(extent.begin(), extent.end(), l->extent.begin(), l->extent.end()))
+	{
+		++layout_hits;
+		return l->edges.data();
+	}
+
+	++layout_misses;
+
+	if (l->kind != layout_widget::none)
+	{
+		int *edges = arena.alloc_array<int>(extent.size() + 1);
+		accumulate(extent.begin(), extent.size(), edges);
+		return edges;
+	}
+
+	l->kind = layout_widget::fixed;
+	l->extent.assign(extent.begin(), extent.end());
+	l->edges.resize(extent.size() + 1);
+	accumulate(extent.begin(), extent.size(), l->edges.data());
+
+	return l->edges.data();
+}
+
+// the vertical divisions of a grid share its id, so they get their own key
+
+static widget_id vertical(widget_id id)
+{
+	return hash_id("vbox", 4, id);
+}
+
+void hbox::create(window *win, widget_id id, rect bounds, uint32_t columns)
+{
+	edges = win->layout(id, bounds.width(), columns);
+	x1 = bounds.x1;
+
+	next.y1 = bounds.y1;
+	next.y2 = bounds.y2;
+}
+
+void hbox::create(window *win, widget_id id, rect bounds, slice<uint32_t> weight)
+{
+	edges = win->layout(id, bounds.width(), weight);
+	x1 = bounds.x1;
+
+	next.y1 = bounds.y1;
+	next.y2 = bounds.y2;
+}
+
+void hbox::create_fixed(window *win, widget_id id, rect bounds, slice<int> extent)
+{
+	edges = win->layout_fixed(id, extent);
+	x1 = bounds.x1;
+
+	next.y1 = bounds.y1;
+	next.y2 = bounds.y2;
+}
+
+void vbox::create(window *win, widget_id id, rect bounds, uint32_t rows)
+{
+	edges = win->layout(vertical(id), bounds.height(), rows);
+	y1 = bounds.y1;
+
+	next.x1 = bounds.x1;
+	next.x2 = bounds.x2;
+}
+
+void vbox::create(window *win, widget_id id, rect bounds, slice<uint32_t> weight)
+{
+	edges = win->layout(vertical(id), bounds.height(), weight);
+	y1 = bounds.y1;
+
+	next.x1 = bounds.x1;
+	next.x2 = bounds.x2;
+}
+
+void vbox::create_fixed(window *win, widget_id id, rect bounds, slice<int> extent)
+{
+	edges = win->layout_fixed(vertical(id), extent);
+	y1 = bounds.y1;
+
+	next.x1 = bounds.x1;
+	next.x2 = bounds.x2;
+}
+
+// ----------------------------------------------------------------------------
+// PANEL
+// ----------------------------------------------------------------------------
+
+abcd::rect begin_panel(window *win, panel_widget *id, abcd::rect r)
+{
+	// the panel takes the input on its area, so widgets drawn under
+	// it (e.g. below a popup) do not see the mouse
+
+	win->hit(id, r);
+
+	id->r = r;
+	id->clip = win->m_clip;
+
+	win->begin_widget(r, "panel", id);
+
+	win->m_clip = intersection(win->m_clip, win->to_window(id->r));
+	win->m_origin.x += id->r.x1;
+	win->m_origin.y += id->r.y1;
+
+	win->mouse_x -= id->r.x1;
+	win->mouse_y -= id->r.y1;
+
+	return r;
+}
+
+rect end_panel(window *win, panel_widget *id)
+{
+	win->end_widget();
+	win->mouse_x += id->r.x1;
+	win->mouse_y += id->r.y1;
+
+	win->m_origin.x -= id->r.x1;
+	win->m_origin.y -= id->r.y1;
+	win->m_clip = id->clip;
+
+	return id->r;
+}
+
+// copies the pixels of r, in window coordinates, between the surface
+// of draw and saved
+
+static void copy_pixels(Draw *draw, rect r, uint32_t *saved, bool restore)
+{
+	draw->flush();
+
+	int stride = draw->stride();
+	uint8_t *pixels = draw->pixels();
+
+	for (int y = r.y1; y < r.y2; ++y, saved += r.width())
+	{
+		uint32_t *p = (uint32_t *)(pixels + size_t(y) * stride) + r.x1;
+		if (restore)
+			memcpy(p, saved, r.width() * 4);
+		else
+			memcpy(saved, p, r.width() * 4);
+	}
+
+	if (restore)
+		draw->mark_dirty(r);
+}
+
+bool begin_deferrable_panel(window *win, deferrable_panel_widget *id, abcd::rect r, priority p)
+{
+	float budget = win->budget_ms;
+	if (p == priority::low)
+		budget *= 0.5f;
+
+	rect saved = intersection(win->m_clip, win->to_window(r));
+
+	// only with the pixels of the same area to show instead
+
+	bool deferrable = p != priority::high && win->budget_ms > 0 && win->m_layers.empty()
+		&& id->deferred < win->max_deferred && !id->pixels.empty()
+		&& saved.x1 == id->saved.x1 && saved.y1 == id->saved.y1
+		&& saved.x2 == id->saved.x2 && saved.y2 == id->saved.y2;
+
+	if (deferrable && win->elapsed_ms() + id->cost_ms > budget)
+	{
+		win->hit(id, r);
+
+		// in call order, so what is drawn later still goes over them
+
+		copy_pixels(win->draw, saved, id->pixels.data(), true);
+
+		++id->deferred;
+		++win->m_frame.deferred;
+
+		return false;
+	}
+
+	id->deferred = 0;
+	id->saved = saved;
+	id->start = std::chrono::steady_clock::now();
+
+	begin_panel(win, id, r);
+	return true;
+}
+
+rect end_deferrable_panel(window *win, deferrable_panel_widget *id)
+{
+	rect r = end_panel(win, id);
+
+	std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now() - id->start;
+	id->cost_ms = ms.count();
+
+	// taken before anything else is drawn over the panel
+
+	rect saved = id->saved;
+	if (saved.width() > 0 && saved.height() > 0 && win->m_layers.empty())
+	{
+		id->pixels.resize(size_t(saved.width()) * saved.height());
+		copy_pixels(win->draw, saved, id->pixels.data(), false);
+	}
+	else
+		id->pixels.clear();
+
+	return r;
+}
+
+float window::elapsed_ms()
+{
+	std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now() - m_frame_start;
+	return ms.count();
+}
+
+// ----------------------------------------------------------------------------
+// LABEL
+// ----------------------------------------------------------------------------
+
+void label(window *win, widget *id, abcd::rect r, std::string_view text, int xa, int ya)
+{
+	win->begin_widget(r, "label", id);
+
+	auto &t = win->m_theme;
+	win->draw->set_font(t.font_family(), t.font_size());
+
+	win->draw->set_solid_paint(win->m_theme.text());
+	win->draw->text(win->arena.c_str(text), r, xa, ya);
+
+	win->end_widget();
+}
+
+// ----------------------------------------------------------------------------
+// BUTTON
+// ----------------------------------------------------------------------------
+
+bool button(window *win, widget *id, abcd::rect r, std::string_view text)
+{
+	bool clicked = win->pointer(id, r) & pointer_released;
+
+	win->begin_widget(r, "button", id);
+
+	bool held = win->mouse_down && win->mouse_widget == id;
+	auto str = win->arena.c_str(text);
+
+
+	auto &t = win->m_theme;
+	win->draw->set_font(t.font_family(), t.font_size());
+
+	if (held)
+	{
+		win->draw->set_solid_paint(win->m_theme.fore());
+		win->draw->stroke_rounded_rectangle(r, 4, 4);
+
+		win->draw->set_solid_paint(win->m_theme.text());
+		win->draw->text(str, r, 0, 0);
+	}
+	else
+	{
+		win->draw->set_solid_paint(win->m_theme.fore());
+		win->draw->fill_rounded_rectangle(r, 4, 4);
+
+		win->draw->set_solid_paint(win->m_theme.text());
+		win->draw->text(str, r, 0, 0);
+	}
+
+	win->end_widget();
+
+	return clicked;
+}
+
+// ----------------------------------------------------------------------------
+// CHECK BUTTON
+// ----------------------------------------------------------------------------
+
+bool checkbutton(window *win, widget *id, abcd::rect r, bool *value)
+{
+	bool clicked = win->pointer(id, r) & pointer_released;
+
+	if (clicked)
+		*value = !*value;
+
+	win->begin_widget(r, "checkbutton", id);
+
+	int a;
+	abcd::rect ri;
+
+	if (r.width() > r.height())
+	{
+		a = r.height();
+		int radius = a * 0.8 / 2;
+		int b = (a - radius*2) / 2; 
+		int x1 = r.x1 + (!*value ? b : r.width() - b - 2 * radius);
+		int y1 = r.y1 + b;
+		ri = {x1, y1, x1 + 2*radius, y1 + 2*radius};
+	}
+	else
+	{
+		a = r.width();
+		int radius = a * 0.8 / 2;
+		int b = (a - radius*2) / 2; 
+		int x1 = r.x1 + b;
+		int y1 = r.y1 + (!*value ? b : r.height() - b - 2 * radius);
+		ri = {x1, y1, x1 + 2*radius, y1 + 2*radius};
+	}
+
+	win->draw->set_solid_paint(win->m_theme.back());
+	win->draw->fill_rounded_rectangle(r, a/2, a/2);
+
+	win->draw->set_solid_paint(win->m_theme.fore());
+	win->draw->fill_arc(ri, 0, 360);
+
+
+
+	win->end_widget();
+
+	return clicked;
+}
+
+// ----------------------------------------------------------------------------
+// RADIO BUTTON
+// ----------------------------------------------------------------------------
+
+bool radiobutton(window *win, widget *id, abcd::rect r, int index, int *value)
+{
+	bool clicked = win->pointer(id, r) & pointer_released;
+
+	win->begin_widget(r, "radiobutton", id);
+
+	bool changed = false;
+
+	if (clicked)
+	{
+		changed = (*value != index);
+		*value = index;
+	}
+
+
+	auto &t = win->m_theme;
+	win->draw->set_font(t.font_family(), t.font_size());
+
+	int size = std::min(r.width(), r.height());
+	r = adjust(r, size, size);
+
+	win->draw->set_solid_paint(win->m_theme.back());
+	win->draw->fill_arc(r, 0, 360);
+
+	if (*value == index)
+	{
+		inflate(r, -1, -1);
+		win->draw->set_solid_paint(win->m_theme.fore());
+		win->draw->fill_arc(r, 0, 360);
+	}
+
+	win->end_widget();
+
+	return changed;
+}
+
+// ----------------------------------------------------------------------------
+// SLIDER
+// ----------------------------------------------------------------------------
+
+/**
+ * thumb tracking along one axis of a slider, in coordinates relative to
+ * the slider origin; returns the new value and the thumb position
+ */
+
+static float slider_track(int extent, int thumbsize, float v, int mouse_z,
+	bool pressed, bool dragging, int &delta, int &thumb_z1)
+{
+	v = std::max(0.f, v);
+	v = std::min(1.f, v);
+
+	thumbsize = std::min(extent, thumbsize);
+	int tracklen = extent - thumbsize;
+
+	if (tracklen <= 0)
+	{
+		thumb_z1 = 0;
+		return v;
+	}
+
+	int z = v * tracklen;
+	thumb_z1 = z;
+
+	if (pressed)
+	{
+		delta = mouse_z - thumb_z1;
+
+		if (delta < 0)
+		{
+			// BEFORE THUMB
+
+			delta = thumbsize / 2;
+			thumb_z1 = mouse_z - delta;
+
+			if (thumb_z1 < 0)
+			{
+				delta = mouse_z;
+				thumb_z1 = mouse_z - delta;
+			}
+
+			v = float(thumb_z1) / tracklen;
+		}
+		else if (delta >= thumbsize)
+		{
+			// AFTER THUMB
+
+			delta = thumbsize / 2;
+			thumb_z1 = mouse_z - delta;
+
+			if (thumb_z1 + thumbsize > extent)
+			{
+				delta = thumbsize - (extent - mouse_z);
+				thumb_z1 = mouse_z - delta;
+			}
+
+			v = float(thumb_z1) / tracklen;
+		}
+	}
+	else if (dragging)
+	{
+		z = std::min(tracklen, mouse_z - delta);
+		z = std::max(0, z);
+
+		thumb_z1 = z;
+
+		v = float(z) / tracklen;
+	}
+
+	return v;
+}
+
+bool slider(window *win, slider_widget *id, abcd::rect r, int thumbsize, float *value, bool horz)
+{
+	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+
+	bool pressed = win->pointer(id, r) & pointer_pressed;
+
+	win->begin_widget(r, "slider", id);
+
+	int extent = horz ? r.width() : r.height();
+	int mouse_z = horz ? mouse.x : mouse.y;
+	int z1;
+
+	float v = slider_track(extent, thumbsize, *value, mouse_z, 
+		pressed, win->mouse_widget == id, id->delta, z1);
+
+	thumbsize = std::min(extent, thumbsize);
+
+	auto thumb = r;
+
+	if (horz)
+	{
+		thumb.x1 = z1;
+		thumb.x2 = z1 + thumbsize;
+	}
+	else
+	{
+		thumb.y1 = z1;
+		thumb.y2 = z1 + thumbsize;
+	}
+
+	win->draw->set_solid_paint(win->m_theme.back());
+	win->draw->fill_rounded_rectangle(r, 3, 3);	
+
+	win->draw->set_solid_paint(win->m_theme.fore());
+	win->draw->fill_rounded_rectangle(thumb, 3, 3);
+
+	win->end_widget();
+
+	bool changed = v != *value;
+	*value = v;	
+	return changed;
+}
+
+// ----------------------------------------------------------------------------
+// KNOB
+// ----------------------------------------------------------------------------
+
+/**
+ * turns angle (degrees, clamped to the knob travel) by the rotation of the
+ * pointer around the knob center from (x1, y1) to (x2, y2), which then
+ * becomes the reference for the next turn
+ */
+
+static float knob_turn(float &x1, float &y1, float x2, float y2, float angle)
+{
+	// signed angle between the two vectors: one atan2, no normalization
+
+	float cross = x1 * y2 - x2 * y1;
+	float dot = x1 * x2 + y1 * y2;
+
+	x1 = x2;
+	y1 = y2;
+
+	angle += atan2f(cross, dot) * float(180 / M_PI);
+
+	angle = std::max(0.f, angle);
+	angle = std::min(270.f, angle);
+
+	return angle;
+}
+
+/**
+ * knob_turn over every pointer sample of the frame and the current mouse
+ * position; (xc, yc) is the knob center in the current coordinates
+ */
+
+static float knob_drag(window *win, float &x1, float &y1, float xc, float yc, float angle)
+{
+	for (auto &s : win->pointer_samples)
+	{
+		float x2 = s.x - win->m_origin.x - xc;
+		float y2 = s.y - win->m_origin.y - yc;
+
+		if (x2 != x1 || y2 != y1)
+			angle = knob_turn(x1, y1, x2, y2, angle);
+	}
+
+	float x2 = win->mouse_x - xc;
+	float y2 = win->mouse_y - yc;
+
+	if (x2 != x1 || y2 != y1)
+		angle = knob_turn(x1, y1, x2, y2, angle);
+
+	return angle;
+}
+
+bool knob(window *win, knob_widget *id, abcd::rect r, float *value)
+{
+	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+
+	int extent = r.width() < r.height() ? r.width() : r.height();
+
+	bool pressed = win->pointer(id, adjust(r, extent, extent)) & pointer_pressed;
+
+	rect r0 = r;
+
+	win->begin_widget(r, "knob", id);
+
+	float v = *value;
+	v = std::max(0.f, v);
+	v = std::min(1.f, v);
+	v = v * 270;
+
+	id->angle = v;
+
+	auto knob = r;
+	
+	knob.x1 = r.width() / 2 - extent / 2;
+	knob.y1 = r.height() / 2 - extent / 2;
+	knob.x2 = knob.x1 + extent;
+	knob.y2 = knob.y1 + extent;
+
+
+	int xc = r.width() / 2;
+	int yc = r.height() / 2;
+
+	if (pressed) 
+	{
+		id->x1 = mouse.x - xc;
+		id->y1 = mouse.y - yc;
+	}
+	else if (win->mouse_widget == id)
+	{
+		id->angle = knob_drag(win, id->x1, id->y1, r0.x1 + xc, r0.y1 + yc, id->angle);
+		v = id->angle;
+	}
+
+	win->draw->set_solid_paint(win->m_theme.fore());
+	win->draw->fill_arc(knob, 0, 360);
+
+
+	win->draw->push();
+	win->draw->translate({xc, yc});
+	win->draw->rotate(id->angle+135);
+	rect index {int(extent * 0.24), -2, int(extent * 0.45), 2};
+	win->draw->set_solid_paint(win->m_theme.text());
+	win->draw->fill_rectangle(index);
+	win->draw->pop();
+
+	win->end_widget();
+
+	v = v / 270.f;
+
+
+
+	bool changed = v != *value;
+	*value = v;	
+	return changed;
+}
+
+
+// ----------------------------------------------------------------------------
+// BANKS
+// ----------------------------------------------------------------------------
+
+/**
+ * press/release handling shared by a whole bank; returns the index of the
+ * element pressed in this frame or -1
+ */
+
+static int bank_press(window *win, widget *id, slice<rect> rects, int &active, bool knobs)
+{
+	if (win->mouse_widget == id && !win->mouse_down)
+	{
+		win->mouse_widget = nullptr;
+		active = -1;
+	}
+
+	int pressed = -1;
+
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		rect r = rects[i];
+
+		if (knobs)
+		{
+			int extent = std::min(r.width(), r.height());
+			r = adjust(r, extent, extent);
+		}
+
+		if (win->pointer(id, r, i) & pointer_pressed)
+		{
+			active = i;
+			pressed = i;
+		}
+	}
+
+	return pressed;
+}
+
+int slider_bank(window *win, slider_bank_widget *id, slice<rect> rects, float *values, int thumbsize, bool horz)
+{
+	ABCD_PROFILE_FUNCTION();
+
+	int pressed = bank_press(win, id, rects, id->active, false);
+	int changed = -1;
+
+	bool dragging = pressed >= 0 || win->mouse_widget == id;
+
+	if (id->active >= 0 && dragging && id->active < int(rects.size()))
+	{
+		int i = id->active;
+		rect r = rects[i];
+		int extent = horz ? r.width() : r.height();
+		int mouse_z = horz ? win->mouse_x - r.x1 : win->mouse_y - r.y1;
+		int z1;
+
+		float v = slider_track(extent, thumbsize, values[i], mouse_z, 
+			pressed == i, true, id->delta, z1);
+
+		if (v != values[i])
+		{
+			values[i] = v;
+			changed = i;
+		}
+	}
+
+	auto draw = win->draw;
+
+	draw->set_solid_paint(win->m_theme.back());
+	for (size_t i = 0; i < rects.size(); ++i)
+		draw->add_rounded_rectangle(rects[i], 3, 3);
+	draw->fill_path();
+
+	draw->set_solid_paint(win->m_theme.fore());
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		rect thumb = rects[i];
+		int extent = horz ? thumb.width() : thumb.height();
+		int size = std::min(extent, thumbsize);
+		float v = std::min(1.f, std::max(0.f, values[i]));
+		int z1 = (horz ? thumb.x1 : thumb.y1) + int(v * (extent - size));
+
+		if (horz)
+		{
+			thumb.x1 = z1;
+			thumb.x2 = z1 + size;
+		}
+		else
+		{
+			thumb.y1 = z1;
+			thumb.y2 = z1 + size;
+		}
+
+		draw->add_rounded_rectangle(thumb, 3, 3);
+	}
+	draw->fill_path();
+
+	return changed;
+}
+
+int knob_bank(window *win, knob_bank_widget *id, slice<rect> rects, float *values)
+{
+	ABCD_PROFILE_FUNCTION();
+
+	int pressed = bank_press(win, id, rects, id->active, true);
+	int changed = -1;
+
+	bool dragging = pressed >= 0 || win->mouse_widget == id;
+
+	if (id->active >= 0 && dragging && id->active < int(rects.size()))
+	{
+		int i = id->active;
+		rect r = rects[i];
+		float xc = r.x1 + r.width() / 2;
+		float yc = r.y1 + r.height() / 2;
+
+		if (pressed == i)
+		{
+			id->x1 = win->mouse_x - xc;
+			id->y1 = win->mouse_y - yc;
+		}
+		else
+		{
+			float angle = std::min(1.f, std::max(0.f, values[i])) * 270;
+			float v = knob_drag(win, id->x1, id->y1, xc, yc, angle) / 270.f;
+
+			if (v != values[i])
+			{
+				values[i] = v;
+				changed = i;
+			}
+		}
+	}
+
+	auto draw = win->draw;
+
+	draw->set_solid_paint(win->m_theme.fore());
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		rect r = rects[i];
+		int extent = std::min(r.width(), r.height());
+		draw->add_arc(adjust(r, extent, extent), 0, 360);
+	}
+	draw->fill_path();
+
+	draw->set_solid_paint(win->m_theme.text());
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		rect r = rects[i];
+		int extent = std::min(r.width(), r.height());
+		float angle = std::min(1.f, std::max(0.f, values[i])) * 270;
+		point center = {r.x1 + r.width() / 2, r.y1 + r.height() / 2};
+		rect index {int(extent * 0.24), -2, int(extent * 0.45), 2};
+		draw->add_rotated_rectangle(center, index, angle + 135);
+	}
+	draw->fill_path();
+
+	return changed;
+}
+
+// ----------------------------------------------------------------------------
+// INPUT
+// ----------------------------------------------------------------------------
+
+bool input(window *win, widget *id, abcd::rect r, std::string& value)
+{
+	if (win->pointer(id, r) & pointer_pressed)
+		win->focus_widget = id;
+
+	win->begin_widget(r, "input", id);
+
+	bool enter = false;
+
+	if (win->focus_widget == id && win->key_down)
+	{
+		// key_utf8 holds all the text typed since the previous frame
+
+		for (auto k = win->key_utf8.begin(); k != win->key_utf8.end(); ++k)
+		{
+			uint8_t c = *k;
+
+			if (c == 8)
+			{
+				while (!value.empty() && (value.back() & 0xC0) == 0x80)
+					value.pop_back();
+				if (!value.empty())
+					value.pop_back();
+			}
+			else if (c == 13)
+			{
+				enter = true;
+			}
+			else if (c > 31 && c != 127)
+			{
+				value += *k;
+			}
+		}
+	}
+
+	auto &t = win->m_theme;
+	win->draw->set_font(t.font_family(), t.font_size());
+
+
+	win->draw->set_solid_paint(win->m_theme.back());
+
+
+	win->draw->fill_rectangle(r);
+
+
+	auto s = value.c_str();
+	size m {0, 0};
+	size_t i = 0;
+	while (i < value.size())
+	{
+		m = win->draw->get_textline_size(s + i);
+		if (m.width < r.width()) break;
+		++i;
+	}
+
+	rect crsr {m.width, 0, m.width + 1, r.height()};
+
+	win->draw->set_stroke_width(1);
+
+	win->draw->set_solid_paint(win->m_theme.text());
+	win->draw->draw_textline(value.c_str() + i, {0, 0});
+
+	if (win->focus_widget == id)
+		win->draw->fill_rectangle(crsr);
+
+	win->end_widget();
+
+	return enter;
+}
+
+// ----------------------------------------------------------------------------
+// SCROLLBAR
+// ----------------------------------------------------------------------------
+
+// vertical bar over doc units of which view are visible, s.value being
+// the first visible one; mouse is in the coordinates of bar. Follows the
+// drag of the thumb and returns true when a press fell on the bar
+
+static bool vscrollbar(window *win, scroll_state &s, rect bar, float doc, float view, 
+	point mouse, bool pressed, bool released)
+{
+	int track = bar.height();
+	int thumb = std::min(track, std::max(12, int(track * view / doc)));
+	float nd = std::max(0.f, doc - view);
+	int ns = track - thumb;
+	float ratio = ns > 0 ? nd / ns : 0;	// units per pixel
+
+	s.value = std::max(0.f, std::min(nd, s.value));
+
+	if (s.dragging)
+	{
+		int y1 = std::max(0, std::min(ns, mouse.y - bar.y1 - s.grab));
+		s.value = std::min(nd, y1 * ratio);
+	}
+
+	rect t = bar;
+	t.y1 = bar.y1 + (ratio > 0 ? int(s.value / ratio) : 0);
+	t.y2 = t.y1 + thumb;
+
+	bool taken = pressed && contains(bar, mouse);
+
+	if (taken && contains(t, mouse))
+	{
+		s.grab = mouse.y - t.y1;
+		s.dragging = true;
+	}
+
+	if (released)
+		s.dragging = false;
+
+	win->draw->set_solid_paint(win->m_theme.back());
+	win->draw->fill_rectangle(bar);
+
+	win->draw->set_solid_paint(win->m_theme.fore());
+	win->draw->fill_rounded_rectangle(t, 3, 3);
+
+	return taken;
+}
+
+// ----------------------------------------------------------------------------
+// LIST
+// ----------------------------------------------------------------------------
+
+bool list(window *win, list_widget *id, abcd::rect r, slice<std::string> items, int &value)
+{
+	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+
+	// a fast click can both press and release in one frame
+
+	int ptr = win->pointer(id, r);
+
+	bool pressed = ptr & pointer_pressed;
+	bool released = ptr & pointer_released;
+
+	if (pressed)
+	{
+		win->focus_widget = id;
+	}
+	
+	if (!released && !win->mouse_down && win->mouse_widget == id)
+	{
+		// released outside the list
+
+		win->mouse_widget = nullptr;
+		released = true;
+	}
+
+	win->begin_widget(r, "list", id);
+
+	auto &t = win->m_theme;
+	win->draw->set_font(t.font_family(), t.font_size());
+	float height = win->draw->get_font_height();
+
+	int view = ceil(r.height() / float(height)); 
+	int doc = int(items.size())+1;
+	bool on_bar = false;
+
+	if (doc > view)
+	{
+		rect scr = split(r, 2, 16);
+		on_bar = vscrollbar(win, id->scroll, scr, doc, view, mouse, pressed, released);
+	}
+
+	int k = -ceil(id->scroll.value);
+	int yoffset = k * height;
+
+	bool index_changed = false;
+
+	if (pressed && !on_bar)
+	{
+		int new_value = (-yoffset + mouse.y) / height;			
+
+		if ((new_value < doc -1) && new_value != value)
+		{
+			value = new_value;
+			index_changed = true;
+		}
+	}
+
+	win->draw->set_solid_paint(win->m_theme.back());
+	win->draw->fill_rectangle(r);
+
+	win->draw->push();
+	win->draw->clip(r);
+
+	// only the items in view
+
+	int first = std::min(-k, int(items.size()));
+	int last = std::min(first + view, int(items.size()));
 
-	if (vbar_visible)
+	int y = yoffset + first * height;
+	for (int i = first; i < last; ++i)
 	{
-		scr = split(r, 2, 16);
-
-		int thumb = vbar * view / float(doc);
-		if (thumb >= 12)
+		if (i != value)
 		{
-			ratio = float(doc) / vbar;
-
-			nd = doc - view;
-			ns = vbar - thumb;
+			win->draw->set_solid_paint(win->m_theme.text());
+			win->draw->draw_textline(items[i].c_str(), {0, y});
 		}
 		else
 		{
-			thumb = 12;
+			win->draw->set_solid_paint(win->m_theme.fore());
+			win->draw->fill_rectangle({0+1, y+1, r.width()-1, int(y+height-1)});
+
+			win->draw->set_solid_paint(win->m_theme.text());
+			win->draw->draw_textline(items[i].c_str(), {0, y});
+		}
+
+		
+		y += height;
+	}
+
+	win->draw->pop();
+
+	win->end_widget();
+
+	return index_changed;
+}
+
+
+// ----------------------------------------------------------------------------
+// SCROLL PANEL
+// ----------------------------------------------------------------------------
+
+abcd::rect begin_scroll_panel(window *win, scroll_panel_widget *id, abcd::rect r, int content)
+{
+	rect view = r;
 
-			nd = doc - view;
-			ns = vbar - thumb;
+	if (content > r.height())
+	{
+		rect bar = split(view, 2, 16);
+		point mouse = {win->mouse_x, win->mouse_y};
+
+		int ptr = win->pointer(id, bar, 1);
 
-			ratio = float(nd) / ns;
+		bool pressed = ptr & pointer_pressed;
+		bool released = ptr & pointer_released;
+
+		if (!released && !win->mouse_down && win->mouse_widget == id)
+		{
+			win->mouse_widget = nullptr;
+			released = true;
 		}
 
-		thumb_rect = scr;
-		thumb_rect.y1 = int(id->yvalue / ratio);
-		thumb_rect.y2 = thumb_rect.y1 + thumb;
+		vscrollbar(win, id->scroll, bar, content, view.height(), mouse, pressed, released);
 	}
+	else
+		id->scroll.value = 0;
+
+	id->offset = id->scroll.value;
+
+	begin_panel(win, id, view);
+
+	// content coordinates
+
+	win->draw->translate({0, -id->offset});
+	win->m_origin.y -= id->offset;
+	win->mouse_y += id->offset;
+
+	return {0, id->offset, view.width(), id->offset + view.height()};
+}
 
-	if (vbar_visible && id->scrolling)
+abcd::rect end_scroll_panel(window *win, scroll_panel_widget *id)
+{
+	win->m_origin.y += id->offset;
+	win->mouse_y -= id->offset;
+
+	return end_panel(win, id);
+}
+
+row_range visible_rows(window *win, abcd::rect view, int row_height, int rows)
+{
+	row_range range {0, 0};
+
+	if (row_height > 0)
 	{
-		int new_y1 = mouse.y - id->yref;
-		new_y1 = std::max(0, new_y1);
-		new_y1 = std::min(ns, new_y1);
-		id->yvalue = std::min(float(nd), new_y1 * ratio);
-		new_y1 = int(id->yvalue / ratio);
-		move(thumb_rect, thumb_rect.x1, new_y1);
+		range.first = std::max(0, std::min(rows, view.y1 / row_height));
+		range.last = std::max(range.first, std::min(rows, (view.y2 + row_height - 1) / row_height));
 	}
 
-	int k = -ceil(id->yvalue);
-	int yoffset = k * height;
+	win->m_frame.culled += rows - (range.last - range.first);
+	return range;
+}
 
-	bool index_changed = false;
+// ----------------------------------------------------------------------------
+// TABLE
+// ----------------------------------------------------------------------------
+
+bool table_source::less(size_t a, size_t b, int column)
+{
+	return cell(a, column) < cell(b, column);
+}
+
+bool table_source::match(size_t row, std::string_view filter)
+{
+	for (int c = 0; c < columns(); ++c)
+		if (cell(row, c).find(filter) != std::string_view::npos)
+			return true;
 
-	if (btn == pressed)
+	return false;
+}
+
+/**
+ * sorts and filters on a worker thread; the order of the rows shown is
+ * swapped in whole when a job completes. A new job cancels the running
+ * one, whose comparisons check the generation and bail out
+ */
+
+class table_sorter
+{
+	struct cancelled {};
+
+	struct job
 	{
-		if (vbar_visible && contains(scr, mouse))
+		table_source *source;
+		int column;
+		bool descending;
+		std::string filter;
+		uint32_t generation;
+	};
+
+	// one worker per table, fed one job at a time; start() replaces a
+	// job not yet taken and never waits for the one being sorted
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	job m_job {};
+	bool m_pending {false};
+	bool m_quit {false};
+	std::atomic<uint32_t> m_generation {0};
+
+	// as requested by the last start()
+	int m_column {-1};
+	bool m_descending {false};
+	std::string m_filter;
+
+	void run(const job &j)
+	{
+		uint32_t checks = 0;
+		auto check = [&]()
+		{
+			if ((++checks & 4095) == 0 && m_generation != j.generation)
+				throw cancelled();
+		};
+
+		try
 		{
-			if (contains(thumb_rect, mouse))
+			auto v = std::make_shared<std::vector<uint32_t>>();
+			size_t n = j.source->rows();
+			v->reserve(n);
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				check();
+				if (j.filter.empty() || j.source->match(i, j.filter))
+					v->push_back(i);
+			}
+
+			if (j.column >= 0)
 			{
-				id->yref = mouse.y - thumb_rect.y1;
-				id->scrolling = true;	
+				std::stable_sort(v->begin(), v->end(), [&](uint32_t a, uint32_t b)
+				{
+					check();
+					return j.descending ? j.source->less(b, a, j.column) : j.source->less(a, b, j.column);
+				});
 			}
+
+			// under the lock, so a start() in between can't be overwritten
+			// by an order it already made stale
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_generation == j.generation)
+				std::atomic_store(&order, std::shared_ptr<const std::vector<uint32_t>>(v));
 		}
-		else
+		catch (cancelled &)
+		{
+		}
+	}
+
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait(lock, [this]() { return m_pending || m_quit; });
+			if (m_quit)
+				return;
+
+			job j = std::move(m_job);
+			m_pending = false;
+
+			lock.unlock();
+			run(j);
+			lock.lock();
+		}
+	}
+
+public:
+
+	// rows of the source in display order, nullptr for all of them in
+	// source order; read and written with std::atomic_load/store
+	std::shared_ptr<const std::vector<uint32_t>> order;
+
+	~table_sorter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+			++m_generation;
+		}
+		m_wake.notify_one();
+
+		// the job may still hold the source, which need only outlive the
+		// table; a cancelled sort stops within a few thousand comparisons
+		if (m_worker.joinable())
+			m_worker.join();
+	}
+
+	bool same(int column, bool descending, const std::string &filter)
+	{
+		return column == m_column && descending == m_descending && filter == m_filter;
+	}
+
+	void start(table_source *source, int column, bool descending, const std::string &filter)
+	{
+		m_column = column;
+		m_descending = descending;
+		m_filter = filter;
+
 		{
-			int new_value = (-yoffset + mouse.y) / height;			
+			std::lock_guard<std::mutex> lock(m_mutex);
+			uint32_t generation = ++m_generation;
 
-			if ((new_value < doc -1) && new_value != value)
+			if (column < 0 && filter.empty())
 			{
-				value = new_value;
-				index_changed = true;
+				m_pending = false;
+				std::atomic_store(&order, std::shared_ptr<const std::vector<uint32_t>>());
+				return;
 			}
+
+			m_job = {source, column, descending, filter, generation};
+			m_pending = true;
 		}
 
+		if (!m_worker.joinable())
+			m_worker = std::thread([this]() { work(); });
+		m_wake.notify_one();
 	}
-	else if (btn == released)
+};
+
+bool table(window *win, table_widget *id, abcd::rect r, table_source *source, 
+	slice<const char *> headers, slice<uint32_t> weight)
+{
+	point mouse = {win->mouse_x - r.x1, win->mouse_y - r.y1};
+
+	int ptr = win->pointer(id, r);
+
+	bool pressed = ptr & pointer_pressed;
+	bool released = ptr & pointer_released;
+
+	if (pressed)
+		win->focus_widget = id;
+
+	if (!released && !win->mouse_down && win->mouse_widget == id)
 	{
-		id->scrolling = false;
+		win->mouse_widget = nullptr;
+		released = true;
 	}
 
+	win->begin_widget(r, "table", id);
+
+	auto draw = win->draw;
+	auto &t = win->m_theme;
+	draw->set_font(t.font_family(), t.font_size());
+	int height = ceil(draw->get_font_height());
+
+	rect header = split(r, 1, height + 4);
+
+	// a click on a header only restarts the sort; this frame still shows
+	// the order it had and the new one appears once the worker is done
+
+	hbox columns;
+	rect body = r;
+	bool bar = false;
+
+	if (!id->sorter)
+		id->sorter = std::make_shared<table_sorter>();
+
+	auto order = std::atomic_load(&id->sorter->order);
+	size_t rows = order ? order->size() : source->rows();
+	float view = body.height() / float(height);
 
-	if (vbar_visible)
+	if (rows > view)
 	{
-		win->draw->set_solid_paint(win->m_theme.back());
-		win->draw->fill_rectangle(scr);
+		rect scr = split(body, 2, 16);
+		bar = vscrollbar(win, id->scroll, scr, rows, view, mouse, pressed, released);
+		header.x2 = body.x2;
+	}
+	else
+		id->scroll.value = 0;
 
-		win->draw->set_solid_paint(win->m_theme.fore());
-		win->draw->fill_rounded_rectangle(thumb_rect, 3, 3);
+	columns.create(win, hash_id(&id, sizeof(id), 0), header, weight);
+
+	bool changed = false;
+
+	if (pressed && contains(header, mouse))
+	{
+		for (size_t c = 0; c < weight.size(); ++c)
+		{
+			if (mouse.x < columns.cell(c).x2)
+			{
+				if (id->sort_column == int(c))
+					id->descending = !id->descending;
+				else
+				{
+					id->sort_column = c;
+					id->descending = false;
+				}
+				break;
+			}
+		}
+	}
+	else if (pressed && !bar && contains(body, mouse))
+	{
+		size_t i = (id->scroll.value * height + mouse.y - body.y1) / height;
+		if (i < rows)
+		{
+			size_t row = order ? (*order)[i] : i;
+			changed = row != id->selected;
+			id->selected = row;
+		}
 	}
 
-	win->draw->set_solid_paint(win->m_theme.back());
-	win->draw->fill_rectangle(r);
+	if (id->refresh || !id->sorter->same(id->sort_column, id->descending, id->filter))
+	{
+		id->sorter->start(source, id->sort_column, id->descending, id->filter);
+		id->refresh = false;
+	}
 
-	win->draw->push();
-	win->draw->clip(r);
+	// only the rows in view reach the source
+
+	size_t first = size_t(id->scroll.value);
+	size_t last = std::min(rows, first + size_t(ceil(view)) + 1);
+	size_t source_rows = source->rows();
+	int source_columns = source->columns();
+	int y0 = body.y1 - int((id->scroll.value - first) * height);
 
-	int y = yoffset;
-	for (int i = 0; i < (int)items.size(); ++i)
+	draw->set_solid_paint(t.back());
+	draw->fill_rectangle(body);
+
+	for (size_t i = first; i < last; ++i)
 	{
-		if (i != value)
+		size_t row = order ? (*order)[i] : i;
+		if (row == id->selected)
 		{
-			win->draw->set_solid_paint(win->m_theme.text());
-			win->draw->draw_textline(items[i].c_str(), {0, y});
+			int y = y0 + int(i - first) * height;
+			draw->set_solid_paint(t.fore());
+			draw->fill_rectangle({body.x1, y, body.x2, y + height});
 		}
-		else
+	}
+
+	draw->set_solid_paint(t.bg());
+	draw->fill_rectangle(header);
+
+	draw->set_solid_paint(t.text());
+
+	for (size_t c = 0; c < weight.size(); ++c)
+	{
+		rect hc = columns.cell(c);
+
+		const char *title = c < headers.size() ? headers[c] : "";
+		if (int(c) == id->sort_column)
 		{
-			win->draw->set_solid_paint(win->m_theme.fore());
-			win->draw->fill_rectangle({0+1, y+1, r.width()-1, int(y+height-1)});
+			size_t n = strlen(title);
+			char *s = win->arena.alloc_array<char>(n + 3);
+			memcpy(s, title, n);
+			s[n] = ' ';
+			s[n + 1] = id->descending ? 'v' : '^';
+			s[n + 2] = 0;
+			title = s;
+		}
 
-			win->draw->set_solid_paint(win->m_theme.text());
-			win->draw->draw_textline(items[i].c_str(), {0, y});
+		rect cell = {hc.x1 + 4, hc.y1, hc.x2 - 4, hc.y2};
+		draw->text(title, cell, -1, 0);
+
+		// one clip per column for all its cells
+
+		draw->push();
+		draw->clip({hc.x1, body.y1, hc.x2, body.y2});
+
+		cell = {hc.x1 + 4, y0, hc.x2 - 4, y0 + height};
+		for (size_t i = first; i < last; ++i)
+		{
+			size_t row = order ? (*order)[i] : i;
+			if (row < source_rows && int(c) < source_columns)
+				draw->text(win->arena.c_str(source->cell(row, c)), cell, -1, 0);
+			move(cell, cell.x1, cell.y2);
 		}
 
-		
-		y += height;
+		draw->pop();
 	}
 
-	win->draw->pop();
+	win->end_widget();
+
+	return changed;
+}
+
+// ----------------------------------------------------------------------------
+// PARAGRAPH
+// ----------------------------------------------------------------------------
+
+int paragraph(window *win, widget *id, abcd::rect r, std::string_view text, int xa)
+{
+	auto &t = win->m_theme;
+	auto lines = win->m_text.layout(win->draw, t.font_family(), t.font_size(), text, r.width());
+	int height = ceil(win->draw->get_font_height());
+
+	// the lines crossing the clip, in r's coordinates
+
+	rect wr = win->to_window(r);
+	rect visible = intersection(win->m_clip, wr);
+	int first = 0, last = 0;
+
+	if (visible.height() > 0)
+	{
+		int top = visible.y1 - wr.y1;
+		first = std::max(0, top / height);
+		last = std::min(int(lines.size()), (top + visible.height() + height - 1) / height);
+	}
+
+	win->begin_widget(r, "paragraph", id);
+
+	win->draw->set_solid_paint(t.text());
+
+	rect line = {0, first * height, r.width(), (first + 1) * height};
+	for (int i = first; i < last; ++i)
+	{
+		auto l = lines[i];
+		win->draw->text(win->arena.c_str(text.substr(l.begin, l.end - l.begin)), line, xa, -1);
+		move(line, 0, line.y2);
+	}
 
 	win->end_widget();
 
-	return index_changed;
+	return int(lines.size()) * height;
+}
+
+// ----------------------------------------------------------------------------
+// PERF OVERLAY
+// ----------------------------------------------------------------------------
+
+static int hit_rate(uint32_t hits, uint32_t misses)
+{
+	return hits + misses ? int(hits * 100ull / (hits + misses)) : 100;
+}
+
+void perf_overlay(window *win, widget *id, abcd::rect r)
+{
+	win->begin_widget(r, "perf_overlay", id);
+
+	auto draw = win->draw;
+	auto &t = win->m_theme;
+	auto &st = win->stats;
+	auto &c = st.last;
+
+	color bg = t.bg();
+	bg.a = 200;
+	draw->set_solid_paint(bg);
+	draw->fill_rectangle(r);
+
+	draw->set_font(t.font_family(), t.font_size() * 0.6f);
+	int line = int(draw->get_font_height() + 0.5f);
+
+	rect graph = r;
+	inflate(graph, -4, -4);
+	graph.y2 = std::max(graph.y1, graph.y2 - 5 * line);
+
+	// the scale grows to twice the 60 Hz budget when frames get slower
+
+	const float budget = 1000 / 60.f;
+	int n = std::min<int>(st.frames, frame_stats::history);
+	float max_ms = 0;
+	for (int i = 0; i < n; ++i)
+		max_ms = std::max(max_ms, st.frame_time(i));
+
+	float scale = graph.height() / (max_ms > budget ? 2 * budget : budget);
+	int bar = std::max(1, graph.width() / frame_stats::history);
+
+	draw->set_solid_paint(t.back());
+	draw->fill_rectangle(graph);
+
+	draw->set_solid_paint(t.fore());
+	for (int i = 0; i < n; ++i)
+	{
+		int x2 = graph.x2 - i * bar;
+		if (x2 - bar < graph.x1)
+			break;
+
+		int h = std::min(graph.height(), int(st.frame_time(i) * scale + 0.5f));
+		draw->add_rectangle({x2 - bar, graph.y2 - h, x2, graph.y2});
+	}
+	draw->fill_path();
+
+	int budget_y = graph.y2 - int(budget * scale);
+	draw->set_solid_paint(t.text());
+	draw->fill_rectangle({graph.x1, budget_y, graph.x2, budget_y + 1});
+
+	char s[5][96];
+	snprintf(s[0], sizeof(s[0]), "frame %.2f ms  max %.2f ms", n ? st.frame_time() : 0.f, max_ms);
+	snprintf(s[1], sizeof(s[1]), "draw calls %u  allocations %u  animations %u", 
+		c.draw_calls, c.allocations, c.animations);
+	snprintf(s[2], sizeof(s[2]), "font hits %d%%  layout hits %d%%", 
+		hit_rate(c.font_hits, c.font_misses), hit_rate(c.layout_hits, c.layout_misses));
+	snprintf(s[3], sizeof(s[3]), "widgets %u  clipped %u  culled %u  deferred %u", 
+		c.widgets, c.clipped, c.culled, c.deferred);
+	snprintf(s[4], sizeof(s[4]), "damage %u/%u tiles  diff %.3f ms", st.dirty_tiles, st.tiles, st.diff_ms);
+
+	rect text = {graph.x1, graph.y2 + 2, graph.x2, graph.y2 + 2 + line};
+	for (auto str : s)
+	{
+		draw->text(str, text, -1, 0);
+		move(text, text.x1, text.y2);
+	}
+
+	win->end_widget();
+}
+
+// ----------------------------------------------------------------------------
+// WIDGETS WITH LIBRARY-OWNED STATE
+// ----------------------------------------------------------------------------
+
+bool button(window *win, const char *name, abcd::rect r, std::string_view text)
+{
+	return button(win, win->state<widget>(name), r, text);
+}
+
+bool checkbutton(window *win, const char *name, abcd::rect r, bool *value)
+{
+	return checkbutton(win, win->state<widget>(name), r, value);
+}
+
+bool radiobutton(window *win, const char *name, abcd::rect r, int index, int *value)
+{
+	return radiobutton(win, win->state<widget>(name), r, index, value);
+}
+
+bool slider(window *win, const char *name, abcd::rect r, int thumbsize, float *value, bool horz)
+{
+	return slider(win, win->state<slider_widget>(name), r, thumbsize, value, horz);
+}
+
+bool knob(window *win, const char *name, abcd::rect r, float *value)
+{
+	return knob(win, win->state<knob_widget>(name), r, value);
+}
+
+bool input(window *win, const char *name, abcd::rect r, std::string& value)
+{
+	return input(win, win->state<widget>(name), r, value);
+}
+
+bool list(window *win, const char *name, abcd::rect r, slice<std::string> items, int &value)
+{
+	return list(win, win->state<list_widget>(name), r, items, value);
+}
+
+bool table(window *win, const char *name, abcd::rect r, table_source *source, 
+	slice<const char *> headers, slice<uint32_t> weight)
+{
+	return table(win, win->state<table_widget>(name), r, source, headers, weight);
+}
+
+int slider_bank(window *win, const char *name, slice<rect> rects, float *values, int thumbsize, bool horz)
+{
+	return slider_bank(win, win->state<slider_bank_widget>(name), rects, values, thumbsize, horz);
+}
+
+int knob_bank(window *win, const char *name, slice<rect> rects, float *values)
+{
+	return knob_bank(win, win->state<knob_bank_widget>(name), rects, values);
+}
+
+abcd::rect begin_panel(window *win, const char *name, abcd::rect r)
+{
+	auto id = win->state<panel_widget>(name);
+	win->push_id(name);
+	return begin_panel(win, id, r);
+}
+
+abcd::rect end_panel(window *win, const char *name)
+{
+	win->pop_id();
+	return end_panel(win, win->state<panel_widget>(name));
+}
+
+bool begin_deferrable_panel(window *win, const char *name, abcd::rect r, priority p)
+{
+	auto id = win->state<deferrable_panel_widget>(name);
+	if (!begin_deferrable_panel(win, id, r, p))
+		return false;
+
+	win->push_id(name);
+	return true;
 }
 
+abcd::rect end_deferrable_panel(window *win, const char *name)
+{
+	win->pop_id();
+	return end_deferrable_panel(win, win->state<deferrable_panel_widget>(name));
+}
+
+abcd::rect begin_scroll_panel(window *win, const char *name, abcd::rect r, int content)
+{
+	auto id = win->state<scroll_panel_widget>(name);
+	win->push_id(name);
+	return begin_scroll_panel(win, id, r, content);
+}
+
+abcd::rect end_scroll_panel(window *win, const char *name)
+{
+	win->pop_id();
+	return end_scroll_panel(win, win->state<scroll_panel_widget>(name));
+}
 
 
 } // abcd
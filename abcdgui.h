@@ -22,14 +22,113 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
 #include <functional>
+#include <type_traits>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 
 #include "abcddraw.h"
 
 namespace abcd {
 
 
+// ---------------------------------------------------------
+// FRAME ARENA
+// ---------------------------------------------------------
+
+/**
+ * bump allocator for per-frame temporaries; reset() rewinds it but keeps
+ * its blocks, so a frame that fits in previous frames' memory never
+ * reaches the heap
+ */
+
+class frame_arena
+{
+	std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+	std::vector<size_t> m_sizes;
+	size_t m_block {0};
+	size_t m_used {0};
+
+public:
+
+	static constexpr size_t block_size = 64 * 1024;
+
+	void *alloc(size_t size, size_t align = alignof(std::max_align_t))
+	{
+		while (m_block < m_blocks.size())
+		{
+			size_t start = (m_used + align - 1) & ~(align - 1);
+
+			if (start + size <= m_sizes[m_block])
+			{
+				m_used = start + size;
+				return m_blocks[m_block].get() + start;
+			}
+
+			++m_block;
+			m_used = 0;
+		}
+
+		size_t n = std::max(block_size, size + align);
+		m_blocks.emplace_back(new uint8_t[n]);
+		m_sizes.push_back(n);
+		m_block = m_blocks.size() - 1;
+		m_used = 0;
+
+		return alloc(size, align);
+	}
+
+	template <class T>
+	T *alloc_array(size_t n)
+	{
+		return static_cast<T *>(alloc(n * sizeof(T), alignof(T)));
+	}
+
+	/**
+	 * returns a null terminated copy of s, valid until the next reset
+	 */
+
+	const char *c_str(std::string_view s)
+	{
+		auto p = alloc_array<char>(s.size() + 1);
+		std::copy(s.begin(), s.end(), p);
+		p[s.size()] = 0;
+		return p;
+	}
+
+	void reset()
+	{
+		m_block = 0;
+		m_used = 0;
+	}
+};
+
+
+// ---------------------------------------------------------
+// IDS
+// ---------------------------------------------------------
+
+typedef uint32_t widget_id;
+
+/**
+ * hashes data into a widget id, chaining from seed (the enclosing id scope);
+ * the result is never 0, which marks an empty slot in the state pool
+ */
+widget_id hash_id(const void *data, size_t length, widget_id seed);
+
+
 class theme
 {
 	std::vector<color> m_colors;
@@ -79,7 +178,75 @@ public:
 };
 
 
+/**
+ * a font to warm up, see window::prewarm()
+ */
+
+struct font_spec
+{
+	const char *family;
+	float size;
+};
+
 class grid;
+struct window;
+
+// ---------------------------------------------------------
+// DIVISIONS
+// ---------------------------------------------------------
+
+/**
+ * edges[0..n] of n cells sharing length in proportion to weight
+ */
+
+constexpr void divide(int length, const uint32_t *weight, size_t n, int *edges)
+{
+	double sum = 0;
+	double x = 0;
+
+	for (size_t i = 0; i < n; ++i) sum += weight[i];
+
+	edges[0] = 0;
+
+	// no cells, or all of them empty
+
+	if (sum == 0)
+	{
+		for (size_t i = 0; i < n; ++i)
+			edges[i + 1] = 0;
+		return;
+	}
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		x = x + length * double(weight[i]) / sum;
+		edges[i + 1] = int(0.5 + x);
+	}
+}
+
+/**
+ * edges[0..n] of n cells sharing length evenly
+ */
+
+constexpr void divide(int length, size_t n, int *edges)
+{
+	edges[0] = 0;
+
+	for (size_t i = 1; i <= n; ++i)
+		edges[i] = int(0.5 + double(length) * i / n);
+}
+
+/**
+ * edges[0..n] of n cells of the given extents
+ */
+
+constexpr void accumulate(const int *extent, size_t n, int *edges)
+{
+	edges[0] = 0;
+
+	for (size_t i = 0; i < n; ++i)
+		edges[i + 1] = edges[i] + extent[i];
+}
 
 // ---------------------------------------------------------
 // HBOX
@@ -90,65 +257,59 @@ class hbox
 	friend class grid;
 	rect next;
 	std::vector<int> xpos;
+	const int *edges {nullptr}; // cached by the window, else xpos
 	int x1;
 public:
 
 	void create(rect bounds, uint32_t columns)
 	{
-		std::vector<uint32_t> weight;
-		weight.resize(columns);
-		std::fill(weight.begin(), weight.end(), 1);
-		create(bounds, weight);
+		xpos.resize(columns + 1);
+		divide(bounds.width(), columns, xpos.data());
+		edges = nullptr;
+		x1 = bounds.x1;
+
+		next.y1 = bounds.y1;
+		next.y2 = bounds.y2;
 	}
 
-	void create(rect bounds, const std::vector<uint32_t> weight)
+	void create(rect bounds, slice<uint32_t> weight)
 	{
-		xpos.clear();
-		xpos.reserve(weight.size() + 1);
-		double sum = 0;
+		xpos.resize(weight.size() + 1);
+		divide(bounds.width(), weight.begin(), weight.size(), xpos.data());
+		edges = nullptr;
 		x1 = bounds.x1;
-		double x = 0;
-
-		xpos.push_back(x);
-
-		for (auto w = weight.begin(); w != weight.end(); ++w) sum += *w;
-
-		for (auto w = weight.begin(); w != weight.end(); ++w)
-		{
-			x = x + bounds.width() * *w / sum;
-			xpos.push_back(int(0.5 + x));
-		}
-
 
 		next.y1 = bounds.y1;
 		next.y2 = bounds.y2;
 	}
 
-	void create_fixed(rect bounds, const std::vector<int> extent)
+	void create_fixed(rect bounds, slice<int> extent)
 	{
-		xpos.clear();
-		xpos.reserve(extent.size() + 1);
-		double x = 0;
+		xpos.resize(extent.size() + 1);
+		accumulate(extent.begin(), extent.size(), xpos.data());
+		edges = nullptr;
 		x1 = bounds.x1;
 
-		xpos.push_back(x);
-
-		for (auto e = extent.begin(); e != extent.end(); ++e)
-		{
-			x = x + *e;
-			xpos.push_back(x);
-		}
-
 		next.y1 = bounds.y1;
 		next.y2 = bounds.y2;
 	}
 	
 	rect cell(uint32_t i)
 	{
-		next.x1 = x1 + xpos[i];
-		next.x2 = x1 + xpos[i + 1];
+		auto e = edges ? edges : xpos.data();
+		next.x1 = x1 + e[i];
+		next.x2 = x1 + e[i + 1];
 		return next;
 	}
+
+	/**
+	 * as above, with the edges kept by the window under id and
+	 * recomputed only when the extent or the weights change
+	 */
+
+	void create(window *win, widget_id id, rect bounds, uint32_t columns);
+	void create(window *win, widget_id id, rect bounds, slice<uint32_t> weight);
+	void create_fixed(window *win, widget_id id, rect bounds, slice<int> extent);
 };
 
 // ---------------------------------------------------------
@@ -160,65 +321,59 @@ class vbox
 	friend class grid;
 	rect next;
 	std::vector<int> ypos;
+	const int *edges {nullptr}; // cached by the window, else ypos
 	int y1;
 public:
 
 	void create(rect bounds, uint32_t rows)
 	{
-		std::vector<uint32_t> weight;
-		weight.resize(rows);
-		std::fill(weight.begin(), weight.end(), 1);
-		create(bounds, weight);
+		ypos.resize(rows + 1);
+		divide(bounds.height(), rows, ypos.data());
+		edges = nullptr;
+		y1 = bounds.y1;
+
+		next.x1 = bounds.x1;
+		next.x2 = bounds.x2;
 	}
 
-	void create(rect bounds, const std::vector<uint32_t> weight)
+	void create(rect bounds, slice<uint32_t> weight)
 	{
-		ypos.clear();
-		ypos.reserve(weight.size() + 1);
-		double sum = 0;
-		double y = 0;
+		ypos.resize(weight.size() + 1);
+		divide(bounds.height(), weight.begin(), weight.size(), ypos.data());
+		edges = nullptr;
 		y1 = bounds.y1;
 
-		ypos.push_back(y);
-
-		for (auto w = weight.begin(); w != weight.end(); ++w) sum += *w;
-
-		for (auto w = weight.begin(); w != weight.end(); ++w)
-		{
-			y = y + bounds.height() * *w / sum;
-			ypos.push_back(int(0.5 + y));
-		}
-
-
 		next.x1 = bounds.x1;
 		next.x2 = bounds.x2;
 	}
 
-	void create_fixed(rect bounds, const std::vector<int> extent)
+	void create_fixed(rect bounds, slice<int> extent)
 	{
-		ypos.clear();
-		ypos.reserve(extent.size() + 1);
-		double y = 0; 
+		ypos.resize(extent.size() + 1);
+		accumulate(extent.begin(), extent.size(), ypos.data());
+		edges = nullptr;
 		y1 = bounds.y1;
 
-		ypos.push_back(y);
-
-		for (auto e = extent.begin(); e != extent.end(); ++e)
-		{
-			y = y + *e;
-			ypos.push_back(y);
-		}
-
-		next.y1 = bounds.y1;
-		next.y2 = bounds.y2;
+		next.x1 = bounds.x1;
+		next.x2 = bounds.x2;
 	}
 	
 	rect cell(uint32_t i)
 	{
-		next.y1 = y1 + ypos[i];
-		next.y2 = y1 + ypos[i + 1];
+		auto e = edges ? edges : ypos.data();
+		next.y1 = y1 + e[i];
+		next.y2 = y1 + e[i + 1];
 		return next;
 	}
+
+	/**
+	 * as above, with the edges kept by the window under id and
+	 * recomputed only when the extent or the weights change
+	 */
+
+	void create(window *win, widget_id id, rect bounds, uint32_t rows);
+	void create(window *win, widget_id id, rect bounds, slice<uint32_t> weight);
+	void create_fixed(window *win, widget_id id, rect bounds, slice<int> extent);
 };
 
 // ---------------------------------------------------------
@@ -238,30 +393,202 @@ public:
 	}
 
 	void create(rect bounds, 
-		const std::vector<uint32_t> rweight, const std::vector<uint32_t> cweight)
+		slice<uint32_t> rweight, slice<uint32_t> cweight)
 	{
 		hb.create(bounds, cweight);
 		vb.create(bounds, rweight);
 	}
 
 	void create_fixed(rect bounds, 
-		const std::vector<int> rextent, const std::vector<int> cextent)
+		slice<int> rextent, slice<int> cextent)
 	{
 		hb.create_fixed(bounds, cextent);
 		vb.create_fixed(bounds, rextent);
 	}
+
+	/**
+	 * cached by the window under id, see hbox
+	 */
+
+	void create(window *win, widget_id id, rect bounds, int rows, int columns)
+	{
+		hb.create(win, id, bounds, columns);
+		vb.create(win, id, bounds, rows);
+	}
+
+	void create(window *win, widget_id id, rect bounds, 
+		slice<uint32_t> rweight, slice<uint32_t> cweight)
+	{
+		hb.create(win, id, bounds, cweight);
+		vb.create(win, id, bounds, rweight);
+	}
+
+	void create_fixed(window *win, widget_id id, rect bounds, 
+		slice<int> rextent, slice<int> cextent)
+	{
+		hb.create_fixed(win, id, bounds, cextent);
+		vb.create_fixed(win, id, bounds, rextent);
+	}
 	
 	rect cell(uint32_t r, uint32_t c)
 	{
 		rect next;
-		next.x1 = hb.x1 + hb.xpos[c];
-		next.x2 = hb.x1 + hb.xpos[c + 1];
-		next.y1 = vb.y1 + vb.ypos[r];
-		next.y2 = vb.y1 + vb.ypos[r + 1];
+		rect h = hb.cell(c);
+		rect v = vb.cell(r);
+		next.x1 = h.x1;
+		next.x2 = h.x2;
+		next.y1 = v.y1;
+		next.y2 = v.y2;
 		return next;
 	}
 };
 
+// ---------------------------------------------------------
+// FIXED CAPACITY BOXES
+// ---------------------------------------------------------
+
+/**
+ * hbox, vbox and grid with the cell count as a template argument: the
+ * edges live in inline arrays and everything can be evaluated at
+ * compile time, e.g.
+ *
+ *   constexpr hbox_n<3> toolbar({0, 0, 300, 40}, {1, 2, 1});
+ */
+
+template <size_t N>
+class hbox_n
+{
+	std::array<int, N + 1> xpos {};
+	rect bounds;
+public:
+
+	constexpr hbox_n() {}
+
+	constexpr hbox_n(rect bounds)
+	{
+		create(bounds);
+	}
+
+	constexpr hbox_n(rect bounds, const std::array<uint32_t, N> &weight)
+	{
+		create(bounds, weight);
+	}
+
+	constexpr void create(rect bounds)
+	{
+		this->bounds = bounds;
+		divide(bounds.width(), N, xpos.data());
+	}
+
+	constexpr void create(rect bounds, const std::array<uint32_t, N> &weight)
+	{
+		this->bounds = bounds;
+		divide(bounds.width(), weight.data(), N, xpos.data());
+	}
+
+	constexpr void create_fixed(rect bounds, const std::array<int, N> &extent)
+	{
+		this->bounds = bounds;
+		accumulate(extent.data(), N, xpos.data());
+	}
+
+	constexpr rect cell(size_t i) const
+	{
+		return {bounds.x1 + xpos[i], bounds.y1, bounds.x1 + xpos[i + 1], bounds.y2};
+	}
+};
+
+template <size_t N>
+class vbox_n
+{
+	std::array<int, N + 1> ypos {};
+	rect bounds;
+public:
+
+	constexpr vbox_n() {}
+
+	constexpr vbox_n(rect bounds)
+	{
+		create(bounds);
+	}
+
+	constexpr vbox_n(rect bounds, const std::array<uint32_t, N> &weight)
+	{
+		create(bounds, weight);
+	}
+
+	constexpr void create(rect bounds)
+	{
+		this->bounds = bounds;
+		divide(bounds.height(), N, ypos.data());
+	}
+
+	constexpr void create(rect bounds, const std::array<uint32_t, N> &weight)
+	{
+		this->bounds = bounds;
+		divide(bounds.height(), weight.data(), N, ypos.data());
+	}
+
+	constexpr void create_fixed(rect bounds, const std::array<int, N> &extent)
+	{
+		this->bounds = bounds;
+		accumulate(extent.data(), N, ypos.data());
+	}
+
+	constexpr rect cell(size_t i) const
+	{
+		return {bounds.x1, bounds.y1 + ypos[i], bounds.x2, bounds.y1 + ypos[i + 1]};
+	}
+};
+
+template <size_t R, size_t C>
+class grid_n
+{
+	hbox_n<C> hb;
+	vbox_n<R> vb;
+public:
+
+	constexpr grid_n() {}
+
+	constexpr grid_n(rect bounds)
+	{
+		create(bounds);
+	}
+
+	constexpr grid_n(rect bounds,
+		const std::array<uint32_t, R> &rweight, const std::array<uint32_t, C> &cweight)
+	{
+		create(bounds, rweight, cweight);
+	}
+
+	constexpr void create(rect bounds)
+	{
+		hb.create(bounds);
+		vb.create(bounds);
+	}
+
+	constexpr void create(rect bounds,
+		const std::array<uint32_t, R> &rweight, const std::array<uint32_t, C> &cweight)
+	{
+		hb.create(bounds, cweight);
+		vb.create(bounds, rweight);
+	}
+
+	constexpr void create_fixed(rect bounds,
+		const std::array<int, R> &rextent, const std::array<int, C> &cextent)
+	{
+		hb.create_fixed(bounds, cextent);
+		vb.create_fixed(bounds, rextent);
+	}
+
+	constexpr rect cell(size_t r, size_t c) const
+	{
+		rect h = hb.cell(c);
+		rect v = vb.cell(r);
+		return {h.x1, v.y1, h.x2, v.y2};
+	}
+};
+
 // ---------------------------------------------------------
 // GRID
 // ---------------------------------------------------------
@@ -354,6 +681,489 @@ struct widget
 	std::string name;
 };
 
+// ---------------------------------------------------------
+// STATE POOL
+// ---------------------------------------------------------
+
+/**
+ * library-owned widget state, looked up by (id, type) in an open-addressing
+ * table; states of the same type live together in a chunked pool, so
+ * pointers stay valid until the entry is collected
+ */
+
+class state_pool
+{
+	struct slot
+	{
+		widget_id id;
+		uint32_t type;
+		uint32_t index;
+		uint32_t frame;
+	};
+
+	struct store_base
+	{
+		virtual ~store_base() {}
+		virtual widget *get(uint32_t index) = 0;
+		virtual void release(uint32_t index) = 0;
+	};
+
+	template <class T>
+	struct store : public store_base
+	{
+		std::deque<T> items;
+		std::vector<uint32_t> unused;
+
+		uint32_t acquire()
+		{
+			if (unused.empty())
+			{
+				items.emplace_back();
+				return items.size() - 1;
+			}
+
+			uint32_t index = unused.back();
+			unused.pop_back();
+			items[index] = T();
+			return index;
+		}
+
+		widget *get(uint32_t index) {return &items[index];}
+		void release(uint32_t index) {unused.push_back(index);}
+	};
+
+	std::vector<slot> m_slots;
+	std::vector<std::unique_ptr<store_base>> m_stores;
+	uint32_t m_count {0};
+	uint32_t m_frame {1};
+
+	// types may be first seen on different threads (a renderer per
+	// window, the prewarm worker)
+
+	static uint32_t next_type()
+	{
+		static std::atomic<uint32_t> n {0};
+		return n.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	template <class T>
+	static uint32_t type_of()
+	{
+		static uint32_t type = next_type();
+		return type;
+	}
+
+	uint32_t probe(widget_id id, uint32_t type)
+	{
+		uint32_t mask = m_slots.size() - 1;
+		uint32_t i = (id ^ (type * 0x9E3779B9u)) & mask;
+
+		while (m_slots[i].id != 0)
+		{
+			if (m_slots[i].id == id && m_slots[i].type == type)
+				break;
+			i = (i + 1) & mask;
+		}
+
+		return i;
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<slot> old;
+		old.swap(m_slots);
+		m_slots.resize(capacity, slot {0, 0, 0, 0});
+
+		for (auto s = old.begin(); s != old.end(); ++s)
+		{
+			if (s->id != 0)
+				m_slots[probe(s->id, s->type)] = *s;
+		}
+	}
+
+public:
+
+	template <class T>
+	T *get(widget_id id)
+	{
+		if ((m_count + 1) * 4 > m_slots.size() * 3)
+			rehash(std::max<size_t>(64, m_slots.size() * 2));
+
+		uint32_t type = type_of<T>();
+
+		if (type >= m_stores.size())
+			m_stores.resize(type + 1);
+
+		if (!m_stores[type])
+			m_stores[type].reset(new store<T>());
+
+		auto st = static_cast<store<T> *>(m_stores[type].get());
+
+		slot &s = m_slots[probe(id, type)];
+
+		if (s.id == 0)
+		{
+			s = {id, type, st->acquire(), m_frame};
+			++m_count;
+		}
+
+		s.frame = m_frame;
+
+		return &st->items[s.index];
+	}
+
+	/**
+	 * releases the states not requested since the previous sweep, calling
+	 * released(widget *) for each of them before it can be reused
+	 */
+
+	template <class F>
+	void sweep(F released)
+	{
+		bool removed = false;
+
+		for (auto s = m_slots.begin(); s != m_slots.end(); ++s)
+		{
+			if (s->id != 0 && s->frame != m_frame)
+			{
+				released(m_stores[s->type]->get(s->index));
+				m_stores[s->type]->release(s->index);
+				s->id = 0;
+				--m_count;
+				removed = true;
+			}
+		}
+
+		if (removed)
+			rehash(m_slots.size());
+
+		++m_frame;
+	}
+
+	size_t size() {return m_count;}
+};
+
+// ---------------------------------------------------------
+// EVENT QUEUE
+// ---------------------------------------------------------
+
+struct pointer_sample
+{
+	int x, y;
+	double time;
+};
+
+struct input_event
+{
+	enum type_t : uint8_t {motion, press, release, text};
+
+	uint8_t type;
+	uint8_t button;
+	int x, y;
+	double time;
+
+	// the range of the queue's text buffer (text events) or of its
+	// pointer samples (motion events)
+	uint32_t offset;
+	uint32_t length;
+};
+
+/**
+ * input received between two frames, in arrival order; consecutive
+ * motions collapse into the last one and consecutive text is merged,
+ * so bursts do not grow the queue. Every motion is still kept as a
+ * pointer sample for the widgets that integrate the whole path
+ */
+
+class event_queue
+{
+	std::vector<input_event> m_events;
+	std::string m_text;
+	std::vector<pointer_sample> m_samples;
+
+public:
+
+	void motion(int x, int y, double time);
+	void press(uint32_t button, int x, int y, double time);
+	void release(uint32_t button, int x, int y, double time);
+	void text(std::string_view utf8, double time);
+
+	size_t size() {return m_events.size();}
+	bool empty() const {return m_events.empty();}
+	input_event &operator[](size_t i) {return m_events[i];}
+
+	std::string_view text(const input_event &e)
+	{
+		return std::string_view(m_text).substr(e.offset, e.length);
+	}
+
+	slice<pointer_sample> samples(const input_event &e)
+	{
+		return slice<pointer_sample>(m_samples.data() + e.offset, e.length);
+	}
+
+	/**
+	 * drops the first n events with their text and pointer samples
+	 */
+
+	void consume(size_t n);
+};
+
+// ---------------------------------------------------------
+// HIT INDEX
+// ---------------------------------------------------------
+
+/**
+ * the widget rects of a frame (in window coordinates, clipped), binned
+ * in a uniform grid so the next frame finds the widget under the mouse
+ * with one cell lookup instead of a test per widget
+ */
+
+class hit_index
+{
+public:
+	struct record
+	{
+		widget *id;
+		uint32_t item;
+		rect r;
+	};
+
+	static constexpr int cell_size = 64;
+
+	void add(widget *id, uint32_t item, rect r);
+
+	/**
+	 * indexes the records added since the previous build
+	 */
+
+	void build();
+
+	/**
+	 * topmost record containing pt, in the last built frame
+	 */
+
+	const record *find(point pt);
+
+private:
+	std::vector<record> m_records;
+	std::vector<record> m_frame;
+	std::vector<uint32_t> m_offsets;
+	std::vector<uint32_t> m_cursor;
+	std::vector<uint32_t> m_cells;
+	rect m_bounds;
+	int m_cols {0};
+	int m_rows {0};
+};
+
+enum
+{
+	pointer_hot = 1,
+	pointer_pressed = 2,
+	pointer_released = 4,
+};
+
+/**
+ * cell edges cached across frames by window::layout
+ */
+
+struct layout_widget : public widget
+{
+	enum {none, even, weighted, fixed};
+
+	uint32_t kind {none};
+	int length {0};
+	std::vector<uint32_t> weight;
+	std::vector<int> extent;
+	std::vector<int> edges;
+};
+
+// ---------------------------------------------------------
+// TEXT LAYOUT
+// ---------------------------------------------------------
+
+/**
+ * line breaks of wrapped text. Word widths are measured once per font;
+ * the breaks of each paragraph are kept with the range of widths they
+ * hold for, so a resize only re-wraps the paragraphs whose lines change
+ */
+
+class text_layout
+{
+public:
+
+	struct line
+	{
+		uint32_t begin, end;	// bytes of the text, without the break
+	};
+
+	static constexpr size_t max_words = 64 * 1024;
+	static constexpr size_t max_paragraphs = 4 * 1024;
+
+private:
+
+	// the hashes only pick the entry: the text and font it was made
+	// for are kept and compared, so a collision costs a measure or a
+	// wrap, never another text's lines
+
+	struct word
+	{
+		widget_id font;
+		std::string text;
+		int width;
+	};
+
+	struct paragraph
+	{
+		widget_id font {0};
+		std::string text;
+		int min_width;			// the breaks hold for widths in
+		int max_width;			// [min_width, max_width)
+		std::vector<line> lines;	// relative to the paragraph
+	};
+
+	std::unordered_map<widget_id, word> m_words;
+	std::unordered_map<widget_id, paragraph> m_paragraphs;
+	std::vector<line> m_lines;
+	std::string m_word;
+
+	int word_width(Draw *draw, widget_id font, std::string_view word);
+	void wrap(Draw *draw, widget_id font, std::string_view text, int width, paragraph &p);
+
+public:
+
+	/**
+	 * wraps text to width with the given font, set on draw; paragraphs
+	 * are separated by '\n', lines break at spaces and a word wider than
+	 * width gets a line of its own. The lines stay valid until the next
+	 * call
+	 */
+
+	slice<line> layout(Draw *draw, const char *family, float size, std::string_view text, int width);
+
+	// re-wraps done by layout(), the other paragraphs came from the cache
+
+	uint32_t wraps {0};
+};
+
+// ---------------------------------------------------------
+// FRAME STATS
+// ---------------------------------------------------------
+
+struct frame_stats
+{
+	struct counters
+	{
+		uint32_t draw_calls {0};
+		uint32_t font_hits {0};
+		uint32_t font_misses {0};
+		uint32_t layout_hits {0};
+		uint32_t layout_misses {0};
+		uint32_t widgets {0};		// begin_widget() calls
+		uint32_t clipped {0};		// widgets drawn entirely outside the clip
+		uint32_t culled {0};		// widgets a container did not draw
+		uint32_t animations {0};	// window::animate() values still moving
+		uint32_t deferred {0};		// panels left as they were, see window::budget_ms
+		uint32_t allocations {0};	// as window::frame_allocs
+	};
+
+	static constexpr int history = 120;
+
+	/**
+	 * counters of the last completed frame
+	 */
+	counters last;
+
+	float frame_ms[history] {};	// begin() to end(), see frame_time()
+	uint32_t frames {0};		// frames completed
+
+	// set by frame_diff::compare() after the frame
+
+	float diff_ms {0};
+	uint32_t dirty_tiles {0};
+	uint32_t tiles {0};
+
+	// from the window's construction to the end of its first frame
+	float first_frame_ms {0};
+
+	/**
+	 * duration of the frame i frames before the last one
+	 */
+
+	float frame_time(int i = 0) const
+	{
+		return frame_ms[((int(frames) - 1 - i) % history + history) % history];
+	}
+};
+
+// ---------------------------------------------------------
+// ANIMATION
+// ---------------------------------------------------------
+
+enum class easing
+{
+	linear,
+	out,		// decelerating, for fades and thumbs
+	in_out,
+};
+
+/**
+ * time of the frames, set by window::begin()
+ */
+
+struct frame_clock
+{
+	double now {0};		// seconds since the window was created, or as given to begin()
+	double delta {0};	// since the previous frame
+	double period {1 / 60.0};	// of the display, set by the host
+	uint64_t frame {0};	// frames begun
+};
+
+struct animation_state : public widget
+{
+	float from {0};
+	float to {0};
+	float value {0};
+	double start {0};
+	double end {0};
+	easing curve {easing::out};
+	bool started {false};
+};
+
+// ---------------------------------------------------------
+// LAYER
+// ---------------------------------------------------------
+
+/**
+ * a surface of the window's size for the widgets drawn between
+ * window::begin_layer() and end_layer(), or outside them for layer 0.
+ * The calls of a frame are recorded and only rasterized when they
+ * differ from the ones last rasterized
+ */
+
+struct layer
+{
+	std::unique_ptr<Draw> draw;
+	display_list list;
+	display_player player;
+	std::vector<uint8_t> previous;	// the calls last rasterized
+
+	rect bounds;	// window coordinates, this frame
+	rect drawn;		// as last rasterized
+};
+
+/**
+ * a buffer the layers are composited into, told apart by its pixels,
+ * with the window pixels changed since it was last composited
+ */
+
+struct layer_target
+{
+	const uint8_t *pixels;
+	rect damage;
+	uint32_t frame;		// clock frame of its last composite
+};
+
 struct window
 {
 	theme m_theme;
@@ -368,15 +1178,244 @@ struct window
 	widget *mouse_widget {nullptr};
 	widget *focus_widget {nullptr};
 
+	/**
+	 * the widget under the mouse, resolved in begin() from the rects
+	 * recorded during the previous frame; item tells apart the elements
+	 * of a bank
+	 */
+	widget *hot_widget {nullptr};
+	uint32_t hot_item {0};
+
+	hit_index m_hits;
+	point m_origin {0, 0};
+	rect m_clip;
+
 	bool key_down {false};
 	std::string key_utf8;
 
+	/**
+	 * hosts can either set the mouse and key fields above before begin()
+	 * or push events here; begin() applies the queued events, setting
+	 * mouse_pressed/mouse_released when a button changed state during
+	 * the frame (both for a click shorter than a frame) and collecting
+	 * all the typed text in key_utf8. Events that do not fit in one
+	 * frame (a second click) stay queued: check events.empty() to know
+	 * whether another frame is needed
+	 */
+	event_queue events;
+	bool mouse_pressed {false};
+	bool mouse_released {false};
+	double event_time {0};
+
+	/**
+	 * every pointer position received since the previous frame, in
+	 * window coordinates and arrival order, so drags can follow the
+	 * whole path whatever the frame rate
+	 */
+	std::vector<pointer_sample> pointer_samples;
+
+	state_pool m_states;
+	std::vector<widget_id> m_id_stack;
+
+	/**
+	 * per-frame scratch memory, rewound by begin()
+	 */
+	frame_arena arena;
+
+	/**
+	 * heap allocations made by the last frame (only counted when the
+	 * library is built with ABCD_ALLOC_CHECK); with fail_on_alloc set,
+	 * end() aborts on a frame that allocated
+	 */
+	uint32_t frame_allocs {0};
+	bool fail_on_alloc {false};
+	uint64_t m_allocs_at_begin {0};
+
+	/**
+	 * fonts resolved and measured by prewarm(), handed to the Draw of
+	 * the first begin()
+	 */
+	std::thread m_prewarm;
+	std::unique_ptr<Draw> m_prewarmed;
+	std::chrono::steady_clock::time_point m_created;
+
 	window();
+	~window();
+
+	/**
+	 * resolves fonts, measures their metrics and renders the glyphs of
+	 * charset (printable ascii when empty) on a worker thread, while the
+	 * host sets up its surface; the next begin() waits for the worker
+	 * and gives the results to its Draw. Glyphs go into atlas when given,
+	 * which must not be used before that begin()
+	 */
+
+	void prewarm(slice<font_spec> fonts, std::string_view charset = {}, glyph_atlas *atlas = nullptr);
+
+	/**
+	 * as above, for the theme font
+	 */
+
+	void prewarm(std::string_view charset = {}, glyph_atlas *atlas = nullptr);
+
 	void begin(Draw *draw);
+
+	/**
+	 * as above, with the frame time (seconds) of the host's clock, e.g.
+	 * the presentation time of the display, instead of the time since
+	 * the window was created; see clock
+	 */
+	void begin(Draw *draw, double time);
 	void end();
-	void begin_widget(rect &r);
+	void begin_widget(rect &r, const char *kind = nullptr, const widget *id = nullptr);
 	void end_widget();
 
+	/**
+	 * true, counting it in m_frame.culled, when r (in current coordinates)
+	 * is entirely outside the clip, so the widget can be skipped
+	 */
+
+	bool cull(rect r);
+
+	void apply_events();
+	rect to_window(rect r);
+
+	/**
+	 * records r (in current coordinates) as the area of id for the next
+	 * frame's lookup and tells whether id is the hot widget
+	 */
+
+	bool hit(widget *id, rect r, uint32_t item = 0);
+
+	/**
+	 * hit() plus press/release tracking, returns pointer_* flags
+	 */
+
+	int pointer(widget *id, rect r, uint32_t item = 0);
+
+	void push_id(const char *str);
+	void push_id(int n);
+	void pop_id();
+	widget_id get_id(const char *str);
+	widget_id get_id(int n);
+
+	/**
+	 * cell edges for a box of the given length, computed on the first
+	 * call and reused while id is requested every frame with the same
+	 * length and weights; resizing the window changes the lengths, so
+	 * affected layouts are recomputed on their own. The edges stay valid
+	 * for the frame whatever else is laid out under id
+	 */
+
+	const int *layout(widget_id id, int length, uint32_t cells);
+	const int *layout(widget_id id, int length, slice<uint32_t> weight);
+	const int *layout_fixed(widget_id id, slice<int> extent);
+
+	uint32_t layout_hits {0};
+	uint32_t layout_misses {0};
+
+	text_layout m_text;
+
+	/**
+	 * filled in by end(); containers that skip children add them to
+	 * m_frame.culled while the frame is built
+	 */
+	frame_stats stats;
+	frame_stats::counters m_frame;
+	std::chrono::steady_clock::time_point m_frame_start;
+
+	/**
+	 * draws the frames into count layers, 0 (the default) drawing
+	 * straight into the Draw given to begin(). end() composites them
+	 * into it in order, within damage only: a layer whose calls did not
+	 * change is not drawn again, so an animated popup over a still ui
+	 * costs the popup's rect. Layers are transparent where nothing was
+	 * drawn; the Draw given to begin() must not be drawn into otherwise.
+	 * Each buffer of a ring gets what changed since it was last given;
+	 * buffers are told apart by their pixels, so a host that frees one
+	 * for another calls set_layers() again
+	 */
+	void set_layers(int count);
+
+	/**
+	 * sends the drawing to layer index (> 0), clipped to r, up to the
+	 * matching end_layer(); nothing changes without layers
+	 */
+	void begin_layer(int index, rect r);
+	void end_layer();
+
+	// pixels of the Draw given to begin() written by the last end()
+	// when drawing in layers
+	rect damage;
+
+	/**
+	 * time a frame should take, 0 for none; past it, deferrable panels
+	 * of lower priority keep their pixels of the last frame that drew
+	 * them, for up to max_deferred frames in a row. Not with layers,
+	 * whose base would be rasterized again without the panel
+	 */
+	float budget_ms {0};
+	uint32_t max_deferred {4};
+
+	// milliseconds since begin()
+	float elapsed_ms();
+
+
+	frame_clock clock;
+
+	/**
+	 * a value moving to target over duration seconds, restarted from
+	 * where it is when target changes; the first call returns target.
+	 * The state is kept under id like a widget's
+	 */
+	float animate(widget_id id, float target, float duration, easing curve = easing::out);
+	float animate(const char *name, float target, float duration, easing curve = easing::out);
+
+	/**
+	 * asks for a frame at time (clock seconds), e.g. to blink a caret;
+	 * good for the current frame only, like the widgets
+	 */
+	void wake_at(double time);
+
+	/**
+	 * after end(): clock time at which the next frame is due. That is
+	 * one display period after this frame while something animates,
+	 * now with events still queued and infinity when idle, in which
+	 * case the host can wait for input
+	 */
+	double next_deadline() const;
+
+	double m_wake {HUGE_VAL};
+
+	std::vector<layer> m_layers;
+	std::vector<int> m_layer_stack;	// layers to return to, -1 for none
+	int m_layer {0};
+	Draw *m_target {nullptr};
+	std::vector<layer_target> m_targets;
+	bool m_recomposite {false};
+
+	Draw *begin_layers(Draw *target);
+	void composite();
+	frame_stats::counters draw_counters();
+
+	template <class T>
+	T *state(widget_id id)
+	{
+		return m_states.get<T>(id);
+	}
+
+	template <class T>
+	T *state(const char *name)
+	{
+		T *s = m_states.get<T>(get_id(name));
+
+		// named once, for the profiler scopes of begin_widget()
+		if constexpr (std::is_base_of_v<widget, T>)
+			if (s->name.empty())
+				s->name = name;
+
+		return s;
+	}
 };
 
 struct slider_widget : public widget
@@ -389,20 +1428,121 @@ struct knob_widget : public widget
 	float x1, y1, angle {0};
 };
 
+struct slider_bank_widget : public widget
+{
+	int active {-1};
+	int delta;
+};
+
+struct knob_bank_widget : public widget
+{
+	int active {-1};
+	float x1, y1;
+};
+
+/**
+ * position of a scrollbar: value is the first visible unit (rows,
+ * pixels...) and grab the offset of the mouse in the dragged thumb
+ */
+
+struct scroll_state
+{
+	float value {0};
+	int grab {0};
+	bool dragging {false};
+};
+
 struct list_widget : public widget
 {
-	int yref;
-	float yvalue {0};
-	bool scrolling {false};
+	scroll_state scroll;
 };
 
 
 struct panel_widget : public widget
 {
 	rect r;
+	rect clip;
+};
+
+enum class priority
+{
+	high,		// never deferred
+	normal,		// deferred when the frame would go over budget
+	low,		// deferred once half the budget is spent
+};
+
+struct deferrable_panel_widget : public panel_widget
+{
+	float cost_ms {0};		// taken when last drawn
+	uint32_t deferred {0};	// frames in a row
+	rect saved;				// window coordinates of pixels
+	std::vector<uint32_t> pixels;	// as last drawn
+	std::chrono::steady_clock::time_point start;
+};
+
+struct scroll_panel_widget : public panel_widget
+{
+	scroll_state scroll;	// pixels
+	int offset {0};
+};
+
+struct row_range
+{
+	int first;
+	int last;	// one past the last row
+};
+
+/**
+ * rows of a table; the table asks cell() only for the cells on screen.
+ * less() and match() run on a worker thread while the table is sorted
+ * or filtered, concurrently with the calls made by the ui, and the
+ * default ones call cell(): the data must be safe to read from both
+ */
+
+class table_source
+{
+public:
+	virtual ~table_source() {}
+
+	virtual size_t rows() = 0;
+	virtual int columns() = 0;
+	virtual std::string_view cell(size_t row, int column) = 0;
+
+	/**
+	 * sort order of rows a and b by column
+	 */
+
+	virtual bool less(size_t a, size_t b, int column);
+
+	/**
+	 * whether row passes filter, by default when a cell contains it
+	 */
+
+	virtual bool match(size_t row, std::string_view filter);
+};
+
+class table_sorter;
+
+struct table_widget : public widget
+{
+	scroll_state scroll;
+	size_t selected {SIZE_MAX};	// row of the source
+
+	// set by clicking a header; sort_column -1 keeps the source order
+	int sort_column {-1};
+	bool descending {false};
+
+	// rows must contain it, see table_source::match()
+	std::string filter;
+
+	// set after changing the data: sorts and filters it again
+	bool refresh {false};
+
+	std::shared_ptr<table_sorter> sorter;
 };
 
 void move(rect &r, int x, int y);
+rect intersection(const rect &a, const rect &b);
 bool contains(const rect &r, point pt);
 void inflate(rect &r, int dx, int dy);
 rect split(rect &r, int side, int size);
@@ -432,13 +1572,13 @@ rect pad(rect r, span h, span v);
  * 
  */
 
-void label(window *, widget *, abcd::rect, std::string text, int xa = 0, int ya = 0);
+void label(window *, widget *, abcd::rect, std::string_view text, int xa = 0, int ya = 0);
 
 /**
  * 
  */
 
-bool button(window *win, widget *id, abcd::rect r, std::string text);
+bool button(window *win, widget *id, abcd::rect r, std::string_view text);
 
 /**
  * 
@@ -464,6 +1604,20 @@ bool slider(window *win, slider_widget *id, abcd::rect r, int thumbsize, float *
 
 bool knob(window *win, knob_widget *id, abcd::rect r, float *value);
 
+/**
+ * draws rects.size() sliders, values[i] in rects[i], with one hit test for
+ * the whole bank and one fill per paint; only one slider can be dragged at
+ * a time. Returns the index of the changed value or -1
+ */
+
+int slider_bank(window *win, slider_bank_widget *id, slice<rect> rects, float *values, int thumbsize, bool horz);
+
+/**
+ * as slider_bank, for knobs
+ */
+
+int knob_bank(window *win, knob_bank_widget *id, slice<rect> rects, float *values);
+
 /**
  * 
  */
@@ -474,7 +1628,7 @@ bool input(window *win, widget *id, abcd::rect r, std::string& value);
  * 
  */
 
-bool list(window *win, list_widget *id, abcd::rect r, const std::vector<std::string> &items, int &value);
+bool list(window *win, list_widget *id, abcd::rect r, slice<std::string> items, int &value);
 
 /**
  * 
@@ -488,6 +1642,101 @@ abcd::rect begin_panel(window *win, panel_widget *id, abcd::rect);
 
 abcd::rect end_panel(window *win, panel_widget *id);
 
+/**
+ * a panel showing the part of a content of the given height that fits
+ * r, scrolled by a bar on its right when it does not fit. The widgets
+ * inside are placed in content coordinates; returns the visible part of
+ * the content, so the caller can skip what lies outside it (see
+ * visible_rows() and window::cull())
+ */
+
+abcd::rect begin_scroll_panel(window *win, scroll_panel_widget *id, abcd::rect r, int content);
+abcd::rect end_scroll_panel(window *win, scroll_panel_widget *id);
+
+/**
+ * a panel that may be deferred to a later frame when the frame runs late
+ * (see window::budget_ms) by the time the panel took when last drawn.
+ * Returns false when deferred: the pixels the panel had right after it
+ * was last drawn are painted back in its place, the content must not be
+ * drawn and end_deferrable_panel() not called
+ */
+
+bool begin_deferrable_panel(window *win, deferrable_panel_widget *id, abcd::rect r, 
+	priority p = priority::normal);
+abcd::rect end_deferrable_panel(window *win, deferrable_panel_widget *id);
+
+/**
+ * the rows of fixed height within view, e.g. as returned by
+ * begin_scroll_panel(); the other rows count as culled
+ */
+
+row_range visible_rows(window *win, abcd::rect view, int row_height, int rows);
+
+/**
+ * rows of source in columns laid out by weight under the headers; only
+ * the visible cells are requested. Sorting and filtering run on a worker
+ * thread and the new order replaces the old one when it is complete, so
+ * a large sort never blocks the frame; source must outlive id. Returns
+ * true when the selection changed
+ */
+
+bool table(window *win, table_widget *id, abcd::rect r, table_source *source, 
+	slice<const char *> headers, slice<uint32_t> weight);
+
+/**
+ * text wrapped to the width of r, drawn from its top and clipped to it;
+ * only the lines within the clip are drawn. Returns the height of the
+ * whole text, which may exceed r (e.g. inside a scrolled panel)
+ */
+
+int paragraph(window *win, widget *id, abcd::rect r, std::string_view text, int xa = -1);
+
+/**
+ * frame time graph (against a 60 Hz budget) and the counters of
+ * window::stats, drawn with a few batched fills and texts
+ */
+
+void perf_overlay(window *win, widget *id, abcd::rect r);
+
+
+////////////////////////////////////////////////////////////////
+// WIDGETS WITH LIBRARY-OWNED STATE
+//
+// the name is hashed within the current id scope (see window::push_id)
+// and the widget state is kept by the window while the widget is drawn
+
+bool button(window *win, const char *name, abcd::rect r, std::string_view text);
+bool checkbutton(window *win, const char *name, abcd::rect r, bool *value);
+bool radiobutton(window *win, const char *name, abcd::rect r, int index, int *value);
+bool slider(window *win, const char *name, abcd::rect r, int thumbsize, float *value, bool horz);
+bool knob(window *win, const char *name, abcd::rect r, float *value);
+int slider_bank(window *win, const char *name, slice<rect> rects, float *values, int thumbsize, bool horz);
+int knob_bank(window *win, const char *name, slice<rect> rects, float *values);
+bool input(window *win, const char *name, abcd::rect r, std::string& value);
+bool list(window *win, const char *name, abcd::rect r, slice<std::string> items, int &value);
+bool table(window *win, const char *name, abcd::rect r, table_source *source, 
+	slice<const char *> headers, slice<uint32_t> weight);
+
+/**
+ * also opens an id scope for the widgets inside the panel
+ */
+
+abcd::rect begin_panel(window *win, const char *name, abcd::rect);
+abcd::rect end_panel(window *win, const char *name);
+abcd::rect begin_scroll_panel(window *win, const char *name, abcd::rect r, int content);
+abcd::rect end_scroll_panel(window *win, const char *name);
+bool begin_deferrable_panel(window *win, const char *name, abcd::rect r, 
+	priority p = priority::normal);
+abcd::rect end_deferrable_panel(window *win, const char *name);
+
+
+/**
+ * heap allocations counted so far on this thread; always 0 unless the
+ * library is built with ABCD_ALLOC_CHECK
+ */
+
+uint64_t heap_allocations();
+
 
 } // abcd
 
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "abcdpixel.h"
+#include "abcdgui.h"
+
+namespace abcd {
+
+
+int pixel_size(pixel_format format)
+{
+	return format == pixel_format::rgb565 ? 2 : 4;
+}
+
+// ----------------------------------------------------------------------------
+// UNPREMULTIPLY
+// ----------------------------------------------------------------------------
+
+// 16.16 reciprocals of the alpha values: c * 255 / a == (c * s_recip[a]) >> 16
+
+struct recip_table
+{
+	uint32_t v[256];
+
+	recip_table()
+	{
+		v[0] = 0;
+		for (uint32_t a = 1; a < 256; ++a)
+			v[a] = ((255u << 16) + a / 2) / a;
+	}
+};
+
+static const recip_table s_recip;
+
+static inline uint32_t unpremultiply(uint32_t p)
+{
+	uint32_t a = p >> 24;
+
+	if (a == 0)
+		return 0;
+
+	uint32_t r = (p >> 16) & 0xFF;
+	uint32_t g = (p >> 8) & 0xFF;
+	uint32_t b = p & 0xFF;
+
+	if (a != 255)
+	{
+		uint32_t k = s_recip.v[a];
+		r = std::min(255u, (r * k + 0x8000) >> 16);
+		g = std::min(255u, (g * k + 0x8000) >> 16);
+		b = std::min(255u, (b * k + 0x8000) >> 16);
+	}
+
+	// little endian word of the bytes R, G, B, A
+
+	return (a << 24) | (b << 16) | (g << 8) | r;
+}
+
+static inline uint32_t swap_rb(uint32_t p)
+{
+	return (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+}
+
+static inline uint16_t to_rgb565(uint32_t p)
+{
+	return ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+}
+
+// ----------------------------------------------------------------------------
+// ROW KERNELS
+// ----------------------------------------------------------------------------
+
+void argb32_to_rgba(const uint32_t *src, uint32_t *dst, int n)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+
+	// runs of opaque or fully transparent pixels only need a swizzle;
+	// anything else goes through the reciprocal table
+
+	const __m128i mask_ag = _mm_set1_epi32(0xFF00FF00);
+	const __m128i mask_b = _mm_set1_epi32(0x000000FF);
+	const __m128i opaque = _mm_set1_epi32(0xFF000000);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i a = _mm_and_si128(p, opaque);
+
+		int all_opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(a, opaque)) == 0xFFFF;
+		int all_clear = _mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_setzero_si128())) == 0xFFFF;
+
+		if (all_opaque)
+		{
+			__m128i q = _mm_or_si128(_mm_and_si128(p, mask_ag),
+				_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), mask_b),
+					_mm_slli_epi32(_mm_and_si128(p, mask_b), 16)));
+			_mm_storeu_si128((__m128i *)(dst + i), q);
+		}
+		else if (all_clear)
+		{
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_setzero_si128());
+		}
+		else
+		{
+			for (int k = 0; k < 4; ++k)
+				dst[i + k] = unpremultiply(src[i + k]);
+		}
+	}
+
+#elif defined(__ARM_NEON)
+
+	for (; i + 8 <= n; i += 8)
+	{
+		uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+		uint64_t a = vget_lane_u64(vreinterpret_u64_u8(p.val[3]), 0);
+
+		if (a == ~uint64_t(0))
+		{
+			uint8x8_t b = p.val[0];
+			p.val[0] = p.val[2];
+			p.val[2] = b;
+			vst4_u8((uint8_t *)(dst + i), p);
+		}
+		else if (a == 0)
+		{
+			vst1q_u32(dst + i, vdupq_n_u32(0));
+			vst1q_u32(dst + i + 4, vdupq_n_u32(0));
+		}
+		else
+		{
+			for (int k = 0; k < 8; ++k)
+				dst[i + k] = unpremultiply(src[i + k]);
+		}
+	}
+
+#endif
+
+	for (; i < n; ++i)
+		dst[i] = unpremultiply(src[i]);
+}
+
+void argb32_to_rgba_premultiplied(const uint32_t *src, uint32_t *dst, int n)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+
+	const __m128i mask_ag = _mm_set1_epi32(0xFF00FF00);
+	const __m128i mask_b = _mm_set1_epi32(0x000000FF);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i q = _mm_or_si128(_mm_and_si128(p, mask_ag),
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), mask_b),
+				_mm_slli_epi32(_mm_and_si128(p, mask_b), 16)));
+		_mm_storeu_si128((__m128i *)(dst + i), q);
+	}
+
+#elif defined(__ARM_NEON)
+
+	for (; i + 8 <= n; i += 8)
+	{
+		uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+		uint8x8_t b = p.val[0];
+		p.val[0] = p.val[2];
+		p.val[2] = b;
+		vst4_u8((uint8_t *)(dst + i), p);
+	}
+
+#endif
+
+	for (; i < n; ++i)
+		dst[i] = swap_rb(src[i]);
+}
+
+void argb32_to_rgb565(const uint32_t *src, uint16_t *dst, int n)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+
+	const __m128i mask_r = _mm_set1_epi32(0xF800);
+	const __m128i mask_g = _mm_set1_epi32(0x07E0);
+	const __m128i mask_b = _mm_set1_epi32(0x001F);
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16(short(0x8000));
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+
+		__m128i q0 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 8), mask_r),
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 5), mask_g),
+				_mm_and_si128(_mm_srli_epi32(p0, 3), mask_b)));
+
+		__m128i q1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 8), mask_r),
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 5), mask_g),
+				_mm_and_si128(_mm_srli_epi32(p1, 3), mask_b)));
+
+		// SSE2 only packs with signed saturation: shift the range down
+		// around zero and back
+
+		q0 = _mm_sub_epi32(q0, bias32);
+		q1 = _mm_sub_epi32(q1, bias32);
+		__m128i q = _mm_add_epi16(_mm_packs_epi32(q0, q1), bias16);
+
+		_mm_storeu_si128((__m128i *)(dst + i), q);
+	}
+
+#elif defined(__ARM_NEON)
+
+	for (; i + 8 <= n; i += 8)
+	{
+		uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+		uint16x8_t q = vshll_n_u8(p.val[2], 8);
+		q = vsriq_n_u16(q, vshll_n_u8(p.val[1], 8), 5);
+		q = vsriq_n_u16(q, vshll_n_u8(p.val[0], 8), 11);
+		vst1q_u16(dst + i, q);
+	}
+
+#endif
+
+	for (; i < n; ++i)
+		dst[i] = to_rgb565(src[i]);
+}
+
+// ----------------------------------------------------------------------------
+// COMPOSITING
+// ----------------------------------------------------------------------------
+
+void over_pixels(uint32_t *dst, const uint32_t *src, int n)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i opaque = _mm_set1_epi32(0xFF000000);
+
+	// x / 255 for x <= 255 * 255, rounded
+	auto div255 = [&](__m128i x)
+	{
+		x = _mm_add_epi16(x, c128);
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	};
+
+	auto over = [&](__m128i s, __m128i d)
+	{
+		__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+		return _mm_add_epi16(s, div255(_mm_mullo_epi16(d, _mm_sub_epi16(c255, a))));
+	};
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		int alpha = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, opaque), opaque));
+
+		// overlays are mostly clear around an opaque body
+
+		if (alpha == 0xFFFF)
+		{
+			_mm_storeu_si128((__m128i *)(dst + i), s);
+			continue;
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF)
+			continue;
+
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i lo = over(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = over(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+#endif
+
+	for (; i < n; ++i)
+	{
+		uint32_t s = src[i];
+		uint32_t a = s >> 24;
+
+		if (a == 255)
+			dst[i] = s;
+		else if (s != 0)
+		{
+			auto div255 = [](uint32_t x) {x += 128; return (x + (x >> 8)) >> 8;};
+
+			uint32_t d = dst[i];
+			uint32_t inv = 255 - a;
+
+			dst[i] = (a + div255((d >> 24) * inv)) << 24
+				| ((s >> 16 & 0xFF) + div255((d >> 16 & 0xFF) * inv)) << 16
+				| ((s >> 8 & 0xFF) + div255((d >> 8 & 0xFF) * inv)) << 8
+				| ((s & 0xFF) + div255((d & 0xFF) * inv));
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// FRAME DIFF
+// ----------------------------------------------------------------------------
+
+bool equal_pixels(const uint32_t *a, const uint32_t *b, int n)
+{
+	int i = 0;
+
+	// the differences are or-ed together and tested once: n is a tile
+	// row at most, a branch per vector would cost more than it saves
+
+#if defined(__AVX2__)
+
+	__m256i acc = _mm256_setzero_si256();
+	for (; i + 8 <= n; i += 8)
+	{
+		acc = _mm256_or_si256(acc, _mm256_xor_si256(
+			_mm256_loadu_si256((const __m256i *)(a + i)),
+			_mm256_loadu_si256((const __m256i *)(b + i))));
+	}
+
+	if (!_mm256_testz_si256(acc, acc))
+		return false;
+
+#elif defined(__SSE2__)
+
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 4 <= n; i += 4)
+	{
+		acc = _mm_or_si128(acc, _mm_xor_si128(
+			_mm_loadu_si128((const __m128i *)(a + i)),
+			_mm_loadu_si128((const __m128i *)(b + i))));
+	}
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+		return false;
+
+#elif defined(__ARM_NEON)
+
+	uint32x4_t acc = vdupq_n_u32(0);
+	for (; i + 4 <= n; i += 4)
+		acc = vorrq_u32(acc, veorq_u32(vld1q_u32(a + i), vld1q_u32(b + i)));
+
+	uint64x2_t acc64 = vreinterpretq_u64_u32(acc);
+	if (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1))
+		return false;
+
+#endif
+
+	uint32_t diff = 0;
+	for (; i < n; ++i)
+		diff |= a[i] ^ b[i];
+
+	return diff == 0;
+}
+
+int frame_diff::compare(const uint8_t *prev, const uint8_t *cur, int width, int height, 
+	int stride, frame_stats *stats)
+{
+	auto t0 = std::chrono::steady_clock::now();
+
+	m_columns = (width + tile - 1) / tile;
+	m_rows = (height + tile - 1) / tile;
+	m_bits.assign((size_t(m_columns) * m_rows + 63) / 64, 0);
+	m_rects.clear();
+
+	int count = 0;
+
+	for (int row = 0; row < m_rows; ++row)
+	{
+		int y1 = row * tile;
+		int y2 = std::min(height, y1 + tile);
+		size_t base = size_t(row) * m_columns;
+		int clean = m_columns;
+
+		// pixel rows in memory order, skipping the tiles already dirty
+		// and the rest of the band once every tile is
+
+		for (int y = y1; y < y2 && clean > 0; ++y)
+		{
+			auto a = (const uint32_t *)(prev + size_t(y) * stride);
+			auto b = (const uint32_t *)(cur + size_t(y) * stride);
+
+			for (int col = 0; col < m_columns; ++col)
+			{
+				size_t i = base + col;
+				if (m_bits[i / 64] >> (i % 64) & 1)
+					continue;
+
+				int x1 = col * tile;
+				int n = std::min(width, x1 + tile) - x1;
+
+				if (!equal_pixels(a + x1, b + x1, n))
+				{
+					m_bits[i / 64] |= uint64_t(1) << (i % 64);
+					--clean;
+				}
+			}
+		}
+
+		count += m_columns - clean;
+
+		// runs of dirty tiles, extending a rect of the band above when
+		// the columns match
+
+		size_t band = m_rects.size();
+
+		for (int col = 0; col < m_columns; )
+		{
+			if (!dirty(col, row))
+			{
+				++col;
+				continue;
+			}
+
+			int first = col;
+			while (col < m_columns && dirty(col, row))
+				++col;
+
+			rect r(first * tile, y1, std::min(width, col * tile), y2);
+
+			bool merged = false;
+			for (size_t k = 0; k < band; ++k)
+			{
+				if (m_rects[k].y2 == y1 && m_rects[k].x1 == r.x1 && m_rects[k].x2 == r.x2)
+				{
+					m_rects[k].y2 = y2;
+					merged = true;
+					break;
+				}
+			}
+
+			if (!merged)
+				m_rects.push_back(r);
+		}
+	}
+
+	if (stats)
+	{
+		std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now() - t0;
+		stats->diff_ms = ms.count();
+		stats->dirty_tiles = count;
+		stats->tiles = m_columns * m_rows;
+	}
+
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+// CONVERSION
+// ----------------------------------------------------------------------------
+
+void convert_pixels(const uint8_t *src, int src_stride, 
+	uint8_t *dst, int dst_stride, int width, int height,
+	pixel_format format, slice<rect> damage)
+{
+	int size = pixel_size(format);
+
+	for (auto d = damage.begin(); d != damage.end(); ++d)
+	{
+		int x1 = std::max(0, d->x1);
+		int y1 = std::max(0, d->y1);
+		int x2 = std::min(width, d->x2);
+		int y2 = std::min(height, d->y2);
+		int n = x2 - x1;
+
+		if (n <= 0)
+			continue;
+
+		for (int y = y1; y < y2; ++y)
+		{
+			auto s = (const uint32_t *)(src + y * src_stride) + x1;
+			auto t = dst + y * dst_stride + x1 * size;
+
+			switch (format)
+			{
+				case pixel_format::argb32:
+					memcpy(t, s, n * 4);
+					break;
+
+				case pixel_format::rgba:
+					argb32_to_rgba(s, (uint32_t *)t, n);
+					break;
+
+				case pixel_format::rgba_premultiplied:
+					argb32_to_rgba_premultiplied(s, (uint32_t *)t, n);
+					break;
+
+				case pixel_format::rgb565:
+					argb32_to_rgb565(s, (uint16_t *)t, n);
+					break;
+			}
+		}
+	}
+}
+
+void convert_pixels(const uint8_t *src, int src_stride, 
+	uint8_t *dst, int dst_stride, int width, int height,
+	pixel_format format)
+{
+	convert_pixels(src, src_stride, dst, dst_stride, width, height, 
+		format, {rect(0, 0, width, height)});
+}
+
+
+} // abcd
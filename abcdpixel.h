@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "abcddraw.h"
+
+namespace abcd {
+
+struct frame_stats;
+
+/**
+ * pixel layouts a host surface can ask for; Draw renders ARGB32, i.e.
+ * premultiplied 0xAARRGGBB words in native byte order
+ */
+
+enum class pixel_format
+{
+	argb32,		// plain copy
+	rgba,		// bytes R, G, B, A, straight (non-premultiplied) alpha
+	rgba_premultiplied,	// bytes R, G, B, A, premultiplied alpha
+	rgb565,		// 16 bit words, colors composited over black
+};
+
+/**
+ * bytes per pixel of format
+ */
+
+int pixel_size(pixel_format format);
+
+/**
+ * converts the damage rects of a width x height ARGB32 buffer into dst,
+ * leaving the rest of dst untouched; rects are clipped to the buffer
+ */
+
+void convert_pixels(const uint8_t *src, int src_stride, 
+	uint8_t *dst, int dst_stride, int width, int height,
+	pixel_format format, slice<rect> damage);
+
+/**
+ * converts the whole buffer
+ */
+
+void convert_pixels(const uint8_t *src, int src_stride, 
+	uint8_t *dst, int dst_stride, int width, int height,
+	pixel_format format);
+
+// row kernels, n pixels
+
+void argb32_to_rgba(const uint32_t *src, uint32_t *dst, int n);
+void argb32_to_rgba_premultiplied(const uint32_t *src, uint32_t *dst, int n);
+void argb32_to_rgb565(const uint32_t *src, uint16_t *dst, int n);
+
+/**
+ * true when the n pixels of a and b are the same
+ */
+
+bool equal_pixels(const uint32_t *a, const uint32_t *b, int n);
+
+/**
+ * composites n premultiplied ARGB32 pixels of src over dst
+ */
+
+void over_pixels(uint32_t *dst, const uint32_t *src, int n);
+
+// ---------------------------------------------------------
+// FRAME DIFF
+// ---------------------------------------------------------
+
+/**
+ * damage found by comparing a frame with the previous one in tiles, for
+ * hosts that upload only what changed without trusting the widgets
+ */
+
+class frame_diff
+{
+	std::vector<uint64_t> m_bits;	// one bit per tile, row major
+	std::vector<rect> m_rects;
+	int m_columns {0};
+	int m_rows {0};
+
+public:
+
+	static constexpr int tile = 64;
+
+	/**
+	 * compares two width x height ARGB32 buffers with the same stride,
+	 * rebuilding the dirty tiles and the damage rects; returns the number
+	 * of dirty tiles. The time taken and the tile counts are stored in
+	 * stats when given (e.g. &window::stats, after window::end())
+	 */
+
+	int compare(const uint8_t *prev, const uint8_t *cur, int width, int height, 
+		int stride, frame_stats *stats = nullptr);
+
+	int columns() const {return m_columns;}
+	int rows() const {return m_rows;}
+
+	bool dirty(int column, int row) const
+	{
+		size_t i = size_t(row) * m_columns + column;
+		return m_bits[i / 64] >> (i % 64) & 1;
+	}
+
+	/**
+	 * runs of dirty tiles, merged with the run above when they span the
+	 * same columns, clipped to the frame
+	 */
+
+	slice<rect> damage() const {return m_rects;}
+};
+
+
+} // abcd
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "abcdprofile.h"
+
+#ifdef ABCD_PROFILE
+
+#include <chrono>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+namespace abcd {
+
+static uint64_t now_ns()
+{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+profiler &profiler::current()
+{
+	static thread_local profiler p;
+	return p;
+}
+
+profiler::profiler()
+{
+	static std::atomic<uint32_t> threads {0};
+
+	m_thread = ++threads;
+	m_epoch = now_ns();
+	m_frames.resize(frame_count);
+	m_open.reserve(64);
+}
+
+void profiler::begin_frame()
+{
+	auto &f = m_frames[m_count % frame_count];
+	++m_count;
+
+	// keeps the capacity: a warm profiler does not allocate
+	f.clear();
+	m_open.clear();
+}
+
+void profiler::begin(const char *name, const char *detail, const void *id)
+{
+	if (m_count == 0)
+		return;
+
+	auto &f = m_frames[(m_count - 1) % frame_count];
+
+	event e;
+	e.name = name;
+	e.detail[0] = 0;
+	if (detail)
+	{
+		strncpy(e.detail, detail, sizeof(e.detail) - 1);
+		e.detail[sizeof(e.detail) - 1] = 0;
+	}
+	e.id = id;
+	e.end = 0;
+
+	m_open.push_back(f.size());
+	f.push_back(e);
+
+	// read the clock last, so the bookkeeping is not charged to the scope
+	f.back().begin = now_ns() - m_epoch;
+}
+
+void profiler::end()
+{
+	uint64_t t = now_ns() - m_epoch;
+
+	if (m_open.empty())
+		return;
+
+	m_frames[(m_count - 1) % frame_count][m_open.back()].end = t;
+	m_open.pop_back();
+}
+
+size_t profiler::frames() const
+{
+	return m_count < frame_count ? m_count : frame_count;
+}
+
+const std::vector<profiler::event> &profiler::frame(int i) const
+{
+	int n = frame_count;
+	return m_frames[((int((m_count - 1) % frame_count) + i) % n + n) % n];
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; ++s)
+	{
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 32)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+bool profiler::save_chrome_trace(const char *path) const
+{
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	fprintf(f, "{\"traceEvents\":[\n");
+
+	bool first = true;
+
+	// oldest frame first
+
+	for (int i = 1 - int(frames()); i <= 0; ++i)
+	{
+		for (auto &e : frame(i))
+		{
+			// scopes still open when the trace is saved are left out
+			if (e.end == 0)
+				continue;
+
+			fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+			write_json_string(f, e.detail[0] ? e.detail : e.name);
+			fprintf(f, ",\"cat\":");
+			write_json_string(f, e.name);
+			fprintf(f, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+				e.begin / 1000.0, (e.end - e.begin) / 1000.0, m_thread);
+			if (e.id)
+				fprintf(f, ",\"args\":{\"id\":\"%p\"}", e.id);
+			fprintf(f, "}");
+
+			first = false;
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+
+	return fclose(f) == 0;
+}
+
+} // abcd
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// ---------------------------------------------------------
+// PROFILER
+// ---------------------------------------------------------
+
+/**
+ * scoped timers of the calling thread, kept for the last frame_count
+ * frames and exported as Chrome trace events (chrome://tracing,
+ * ui.perfetto.dev). build with ABCD_PROFILE defined, otherwise the
+ * macros below expand to nothing and no profiler code is compiled
+ */
+
+#ifdef ABCD_PROFILE
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace abcd {
+
+class profiler
+{
+public:
+
+	struct event
+	{
+		const char *name;	// static string, e.g. the widget kind
+		char detail[32];	// e.g. the widget name, truncated
+		const void *id;
+		uint64_t begin;		// ns since the profiler was created
+		uint64_t end;		// 0 while the scope is open
+	};
+
+	static constexpr size_t frame_count = 120;
+
+	/**
+	 * the profiler of the calling thread
+	 */
+
+	static profiler &current();
+
+	void begin_frame();
+	void begin(const char *name, const char *detail = nullptr, const void *id = nullptr);
+	void end();
+
+	/**
+	 * frames recorded, at most frame_count
+	 */
+
+	size_t frames() const;
+
+	/**
+	 * events of frame i, 0 being the current one and -1 the previous one
+	 */
+
+	const std::vector<event> &frame(int i) const;
+
+	bool save_chrome_trace(const char *path) const;
+
+private:
+
+	profiler();
+
+	std::vector<std::vector<event>> m_frames;
+	std::vector<uint32_t> m_open;
+	uint64_t m_count {0};
+	uint64_t m_epoch;
+	uint32_t m_thread;
+};
+
+class profile_scope
+{
+	profiler &m_profiler;
+
+public:
+
+	profile_scope(const char *name) : m_profiler(profiler::current())
+	{
+		m_profiler.begin(name);
+	}
+
+	~profile_scope()
+	{
+		m_profiler.end();
+	}
+};
+
+} // abcd
+
+#define ABCD_PROFILE_CAT2(a, b) a##b
+#define ABCD_PROFILE_CAT(a, b) ABCD_PROFILE_CAT2(a, b)
+
+#define ABCD_PROFILE_FRAME() abcd::profiler::current().begin_frame()
+#define ABCD_PROFILE_BEGIN(name, detail, id) abcd::profiler::current().begin(name, detail, id)
+#define ABCD_PROFILE_END() abcd::profiler::current().end()
+#define ABCD_PROFILE_SCOPE(name) abcd::profile_scope ABCD_PROFILE_CAT(abcd_profile_, __LINE__)(name)
+#define ABCD_PROFILE_FUNCTION() ABCD_PROFILE_SCOPE(__func__)
+
+#else
+
+#define ABCD_PROFILE_FRAME() ((void)0)
+#define ABCD_PROFILE_BEGIN(name, detail, id) ((void)0)
+#define ABCD_PROFILE_END() ((void)0)
+#define ABCD_PROFILE_SCOPE(name) ((void)0)
+#define ABCD_PROFILE_FUNCTION() ((void)0)
+
+#endif
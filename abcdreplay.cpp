@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include <chrono>
+
+#include "abcdreplay.h"
+
+namespace abcd {
+
+static const char magic[8] = "ABCDREC";
+static const uint32_t byte_order = 0x01020304;
+static const uint32_t version = 2;
+
+// longest key or text string of a frame, past which the file is corrupt
+static const uint32_t max_string = 1 << 20;
+
+// ----------------------------------------------------------------------------
+// INPUT RECORDING
+// ----------------------------------------------------------------------------
+
+template <class T>
+static void put(FILE *f, T v)
+{
+	fwrite(&v, sizeof(v), 1, f);
+}
+
+static void put_string(FILE *f, std::string_view s)
+{
+	put<uint32_t>(f, s.size());
+	fwrite(s.data(), 1, s.size(), f);
+}
+
+template <class T>
+static bool get(FILE *f, T &v)
+{
+	return fread(&v, sizeof(v), 1, f) == 1;
+}
+
+static bool get_string(FILE *f, std::string &s)
+{
+	uint32_t n;
+	if (!get(f, n) || n > max_string)
+		return false;
+
+	s.resize(n);
+	return fread(&s[0], 1, n, f) == n;
+}
+
+input_recorder::~input_recorder()
+{
+	close();
+}
+
+bool input_recorder::open(const char *path, int w, int h)
+{
+	close();
+
+	m_file = fopen(path, "wb");
+	if (!m_file)
+		return false;
+
+	fwrite(magic, sizeof(magic), 1, m_file);
+	put(m_file, byte_order);
+	put(m_file, version);
+	put<int32_t>(m_file, w);
+	put<int32_t>(m_file, h);
+
+	return true;
+}
+
+void input_recorder::close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+void input_recorder::record(window *win, double time)
+{
+	if (!m_file)
+		return;
+
+	FILE *f = m_file;
+
+	put(f, time);
+	put<uint8_t>(f, win->mouse_down);
+	put<uint32_t>(f, win->mouse_button);
+	put<int32_t>(f, win->mouse_x);
+	put<int32_t>(f, win->mouse_y);
+	put<uint8_t>(f, win->key_down);
+	put_string(f, win->key_utf8);
+
+	auto &q = win->events;
+	put<uint32_t>(f, q.size());
+
+	for (size_t i = 0; i < q.size(); ++i)
+	{
+		auto &e = q[i];
+
+		put(f, e.type);
+		put(f, e.button);
+		put<int32_t>(f, e.x);
+		put<int32_t>(f, e.y);
+		put(f, e.time);
+
+		// motions are saved as their samples, text events with their text
+
+		if (e.type == input_event::motion)
+		{
+			auto samples = q.samples(e);
+			put<uint32_t>(f, samples.size());
+			for (auto &s : samples)
+			{
+				put<int32_t>(f, s.x);
+				put<int32_t>(f, s.y);
+				put(f, s.time);
+			}
+		}
+		else if (e.type == input_event::text)
+		{
+			put_string(f, q.text(e));
+		}
+	}
+}
+
+input_player::~input_player()
+{
+	close();
+}
+
+bool input_player::open(const char *path)
+{
+	close();
+
+	m_file = fopen(path, "rb");
+	if (!m_file)
+		return false;
+
+	char m[sizeof(magic)];
+	uint32_t order, v;
+	int32_t w, h;
+
+	// recorded in native byte order: a machine of the other one can't
+	// read the file
+
+	if (fread(m, sizeof(m), 1, m_file) != 1 || memcmp(m, magic, sizeof(m)) != 0
+		|| !get(m_file, order) || order != byte_order
+		|| !get(m_file, v) || v != version || !get(m_file, w) || !get(m_file, h))
+	{
+		close();
+		return false;
+	}
+
+	width = w;
+	height = h;
+
+	return true;
+}
+
+void input_player::close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+bool input_player::next(window *win, double &time)
+{
+	if (!m_file)
+		return false;
+
+	FILE *f = m_file;
+
+	uint8_t down, key_down;
+	uint32_t button, count;
+	int32_t x, y;
+
+	if (!get(f, time) || !get(f, down) || !get(f, button) || !get(f, x) || !get(f, y)
+		|| !get(f, key_down) || !get_string(f, win->key_utf8) || !get(f, count))
+		return false;
+
+	win->mouse_down = down;
+	win->mouse_button = button;
+	win->mouse_x = x;
+	win->mouse_y = y;
+	win->key_down = key_down;
+
+	auto &q = win->events;
+	q.consume(q.size());
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint8_t type, b;
+		double t;
+
+		if (!get(f, type) || !get(f, b) || !get(f, x) || !get(f, y) || !get(f, t))
+			return false;
+
+		switch (type)
+		{
+			case input_event::motion:
+			{
+				uint32_t n;
+				if (!get(f, n))
+					return false;
+
+				for (uint32_t j = 0; j < n; ++j)
+				{
+					int32_t sx, sy;
+					double st;
+					if (!get(f, sx) || !get(f, sy) || !get(f, st))
+						return false;
+					q.motion(sx, sy, st);
+				}
+				break;
+			}
+
+			case input_event::press:
+				q.press(b, x, y, t);
+				break;
+
+			case input_event::release:
+				q.release(b, x, y, t);
+				break;
+
+			case input_event::text:
+				if (!get_string(f, m_text))
+					return false;
+				q.text(m_text, t);
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// REPLAY
+// ----------------------------------------------------------------------------
+
+uint64_t hash_pixels(const uint8_t *pixels, int w, int h, int stride)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (int y = 0; y < h; ++y)
+	{
+		const uint8_t *p = pixels + size_t(y) * stride;
+		for (int i = 0; i < w * 4; ++i)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	return hash;
+}
+
+bool replay(const char *path, window *win, std::function<void(window *)> ui, 
+	std::vector<replay_frame> &result)
+{
+	input_player player;
+	if (!player.open(path))
+		return false;
+
+	Draw draw(player.width, player.height, 1);
+
+	replay_frame frame;
+
+	// the frame budget depends on how fast this machine runs the frames,
+	// so deferred panels would change the pixels from run to run
+
+	float budget = win->budget_ms;
+	win->budget_ms = 0;
+
+	while (player.next(win, frame.time))
+	{
+		auto t0 = std::chrono::steady_clock::now();
+
+		win->begin(&draw, frame.time);
+		ui(win);
+		win->end();
+		draw.flush();
+
+		std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now() - t0;
+		frame.ms = ms.count();
+		frame.hash = hash_pixels(draw.pixels(), draw.width(), draw.height(), draw.stride());
+
+		result.push_back(frame);
+	}
+
+	win->budget_ms = budget;
+	return true;
+}
+
+} // abcd
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+#include "abcdgui.h"
+
+namespace abcd {
+
+// ---------------------------------------------------------
+// INPUT RECORDING
+// ---------------------------------------------------------
+
+/**
+ * saves the input a window gets in every frame: the mouse and key
+ * fields set by the host and the queued events, in native byte order
+ * marked in the header; input_player rejects a file of the other order
+ */
+
+class input_recorder
+{
+	FILE *m_file {nullptr};
+
+public:
+
+	~input_recorder();
+
+	/**
+	 * w x h is the size of the recorded window's framebuffer
+	 */
+
+	bool open(const char *path, int w, int h);
+	void close();
+
+	/**
+	 * call right before win->begin(); time is the host frame time, the
+	 * one given to window::begin(draw, time) for animations to replay
+	 * the same
+	 */
+
+	void record(window *win, double time);
+};
+
+class input_player
+{
+	FILE *m_file {nullptr};
+	std::string m_text;
+
+public:
+
+	int width {0};
+	int height {0};
+
+	~input_player();
+
+	/**
+	 * false when the file is not a recording of this version and byte
+	 * order
+	 */
+
+	bool open(const char *path);
+	void close();
+
+	/**
+	 * sets the input of the next recorded frame into win, dropping the
+	 * events still queued there; returns false at the end of the file
+	 * or at truncated or corrupt data
+	 */
+
+	bool next(window *win, double &time);
+};
+
+// ---------------------------------------------------------
+// REPLAY
+// ---------------------------------------------------------
+
+struct replay_frame
+{
+	double time;		// recorded frame time
+	float ms;		// begin() to end() and flush()
+	uint64_t hash;		// of the framebuffer, see hash_pixels()
+};
+
+/**
+ * FNV-1a of the w x h ARGB32 pixels, without the row padding
+ */
+
+uint64_t hash_pixels(const uint8_t *pixels, int w, int h, int stride);
+
+/**
+ * replays a recording into win drawing on its own framebuffer of the
+ * recorded size; ui builds one frame between begin() and end(), at the
+ * recorded frame time and without a frame budget. Frames are appended
+ * to result, returns false if the file cannot be read
+ */
+
+bool replay(const char *path, window *win, std::function<void(window *)> ui, 
+	std::vector<replay_frame> &result);
+
+} // abcd
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <algorithm>
+#include <system_error>
+#include <new>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "abcdshm.h"
+
+namespace abcd {
+
+
+uint64_t monotonic_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+static size_t page_align(size_t n)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (n + page - 1) / page * page;
+}
+
+static const int shm_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+[[noreturn]] static void fail(const char *what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+// ----------------------------------------------------------------------------
+// OUTPUT
+// ----------------------------------------------------------------------------
+
+shm_output::shm_output(int w, int h, int frames, const char *name)
+{
+	frames = std::max(2, std::min(frames, shm_header::max_frames));
+
+	int stride = w * 4;
+	size_t offset = page_align(sizeof(shm_header));
+	size_t frame_size = page_align(size_t(stride) * h);
+	m_size = offset + frame_size * frames;
+
+	if (name)
+	{
+		m_name = name;
+		m_fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	}
+	else
+	{
+		m_fd = memfd_create("abcdgui-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	}
+
+	if (m_fd < 0)
+		fail("abcd: cannot create the frame memory");
+
+	if (ftruncate(m_fd, m_size) != 0)
+		release("abcd: cannot size the frame memory");
+
+	// the host checks the size once: the memfd can't be resized after it
+
+	if (!name && fcntl(m_fd, F_ADD_SEALS, shm_seals) != 0)
+		release("abcd: cannot seal the frame memory");
+
+	void *p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+	if (p == MAP_FAILED)
+		release("abcd: cannot map the frame memory");
+
+	m_map = static_cast<uint8_t *>(p);
+	m_header = new (m_map) shm_header();
+
+	m_header->version = shm_header::version_value;
+	m_header->width = w;
+	m_header->height = h;
+	m_header->stride = stride;
+	m_header->frames = frames;
+	m_header->frame_offset = offset;
+	m_header->sequence.store(0, std::memory_order_relaxed);
+
+	for (int i = 0; i < shm_header::max_frames; ++i)
+		m_header->slots[i].sequence.store(0, std::memory_order_relaxed);
+
+	// the magic goes last: a consumer mapping early sees no header yet
+
+	std::atomic_thread_fence(std::memory_order_release);
+	m_header->magic = shm_header::magic_value;
+}
+
+void shm_output::release(const char *what)
+{
+	int e = errno;
+
+	close(m_fd);
+	if (!m_name.empty())
+		shm_unlink(m_name.c_str());
+
+	errno = e;
+	fail(what);
+}
+
+shm_output::~shm_output()
+{
+	munmap(m_map, m_size);
+	close(m_fd);
+
+	if (!m_name.empty())
+		shm_unlink(m_name.c_str());
+}
+
+void shm_output::begin_frame(Draw *draw)
+{
+	auto &h = *m_header;
+	auto &s = h.slots[(m_sequence + 1) % h.frames];
+
+	// readers of the old frame in this slot notice the change in valid()
+
+	s.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint8_t *pixels = m_map + h.frame_offset 
+		+ (m_sequence + 1) % h.frames * page_align(size_t(h.stride) * h.height);
+
+	draw->rebind(pixels, h.width, h.height, h.stride);
+}
+
+void shm_output::end_frame(slice<rect> damage)
+{
+	auto &h = *m_header;
+	auto &s = h.slots[(m_sequence + 1) % h.frames];
+
+	s.damage_count = damage.size() <= size_t(shm_header::max_damage) ? damage.size() : 0;
+	std::copy(damage.begin(), damage.begin() + s.damage_count, s.damage);
+	s.publish_ns = monotonic_ns();
+
+	++m_sequence;
+	s.sequence.store(m_sequence, std::memory_order_release);
+	h.sequence.store(m_sequence, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+// INPUT
+// ----------------------------------------------------------------------------
+
+void shm_input::map(int fd, bool sealed)
+{
+	// a producer able to shrink the memory later would fault the host
+
+	if (sealed && (fcntl(fd, F_GET_SEALS) & shm_seals) != shm_seals)
+	{
+		close(fd);
+		errno = EPROTO;
+		fail("abcd: frame memory not sealed against resizing");
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		fail("abcd: cannot read the frame memory size");
+	}
+
+	m_fd = fd;
+	m_size = st.st_size;
+
+	void *p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+	if (p == MAP_FAILED)
+	{
+		close(m_fd);
+		fail("abcd: cannot map the frame memory");
+	}
+
+	m_map = static_cast<uint8_t *>(p);
+	m_header = reinterpret_cast<shm_header *>(m_map);
+
+	if (m_size < sizeof(shm_header) || m_header->magic != shm_header::magic_value 
+		|| m_header->version != shm_header::version_value)
+	{
+		munmap(m_map, m_size);
+		close(m_fd);
+		errno = EPROTO;
+		fail("abcd: not an abcd frame memory");
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	// the producer may be another, untrusted process: the geometry is
+	// read once and every frame must lie within the mapping
+
+	auto &h = *m_header;
+	m_width = h.width;
+	m_height = h.height;
+	m_stride = h.stride;
+	m_frames = h.frames;
+	m_frame_offset = h.frame_offset;
+
+	bool ok = m_width > 0 && m_height > 0 && m_stride / 4 >= m_width
+		&& m_frames >= 2 && m_frames <= shm_header::max_frames
+		&& m_frame_offset >= sizeof(shm_header) && m_frame_offset <= m_size;
+
+	if (ok)
+	{
+		m_frame_size = page_align(size_t(m_stride) * m_height);
+		ok = size_t(m_stride) * m_height / m_height == size_t(m_stride)
+			&& m_frame_size <= (m_size - m_frame_offset) / m_frames;
+	}
+
+	if (!ok)
+	{
+		munmap(m_map, m_size);
+		close(m_fd);
+		errno = EPROTO;
+		fail("abcd: frame memory geometry out of bounds");
+	}
+}
+
+shm_input::shm_input(int fd)
+{
+	int d = dup(fd);
+
+	if (d < 0)
+		fail("abcd: cannot duplicate the frame memory descriptor");
+
+	map(d, true);
+}
+
+shm_input::shm_input(const char *name)
+{
+	int fd = shm_open(name, O_RDWR, 0);
+
+	if (fd < 0)
+		fail("abcd: cannot open the frame memory");
+
+	map(fd, false);
+}
+
+shm_input::~shm_input()
+{
+	munmap(m_map, m_size);
+	close(m_fd);
+}
+
+bool shm_input::acquire(uint64_t last_seen, frame &f)
+{
+	auto &h = *m_header;
+	uint64_t seq = h.sequence.load(std::memory_order_acquire);
+
+	if (seq == 0 || seq <= last_seen)
+		return false;
+
+	auto &s = h.slots[seq % m_frames];
+
+	if (s.sequence.load(std::memory_order_acquire) != seq)
+		return false; // already being overwritten, try again
+
+	f.pixels = m_map + m_frame_offset + seq % m_frames * m_frame_size;
+	f.width = m_width;
+	f.height = m_height;
+	f.stride = m_stride;
+	f.sequence = seq;
+	f.publish_ns = s.publish_ns;
+
+	// union of the damage of the frames published since last_seen, as
+	// long as their slots still hold them
+
+	f.full = last_seen == 0 || seq - last_seen >= uint64_t(m_frames);
+	f.damage_count = 0;
+
+	for (uint64_t n = last_seen + 1; !f.full && n <= seq; ++n)
+	{
+		auto &d = h.slots[n % m_frames];
+		uint32_t count = std::min<uint32_t>(d.damage_count, shm_header::max_damage);
+
+		if (count == 0 || f.damage_count + count > uint32_t(shm_header::max_damage))
+			f.full = true;
+
+		// rects are clipped to the frame, inverted ones taken as torn
+
+		for (uint32_t i = 0; !f.full && i < count; ++i)
+		{
+			rect r = d.damage[i];
+
+			if (r.x1 > r.x2 || r.y1 > r.y2)
+			{
+				f.full = true;
+				break;
+			}
+
+			r.x1 = std::max(r.x1, 0);
+			r.y1 = std::max(r.y1, 0);
+			r.x2 = std::min(r.x2, m_width);
+			r.y2 = std::min(r.y2, m_height);
+
+			if (r.x1 < r.x2 && r.y1 < r.y2)
+				f.damage[f.damage_count++] = r;
+		}
+
+		if (d.sequence.load(std::memory_order_acquire) != n)
+			f.full = true;
+	}
+
+	if (f.full)
+	{
+		f.damage_count = 1;
+		f.damage[0] = rect(0, 0, m_width, m_height);
+	}
+
+	return valid(f);
+}
+
+bool shm_input::valid(const frame &f)
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return m_header->slots[f.sequence % m_frames].sequence.load(std::memory_order_relaxed) == f.sequence;
+}
+
+
+} // abcd
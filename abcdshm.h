@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "abcddraw.h"
+
+namespace abcd {
+
+// ---------------------------------------------------------
+// SHARED MEMORY FRAMES
+// ---------------------------------------------------------
+
+/**
+ * layout of the shared mapping: this header, then frames ARGB32 frame
+ * buffers of height * stride bytes each, page aligned
+ */
+
+struct shm_header
+{
+	static constexpr uint32_t magic_value = 0x44434241; // "ABCD"
+	static constexpr uint32_t version_value = 1;
+	static constexpr int max_frames = 4;
+	static constexpr int max_damage = 16;
+
+	struct slot
+	{
+		// frame number held by the slot, 0 while the producer draws in it
+		std::atomic<uint64_t> sequence;
+		// CLOCK_MONOTONIC time of publication, for latency measurements
+		uint64_t publish_ns;
+		uint32_t damage_count; // 0 means the whole frame
+		rect damage[max_damage];
+	};
+
+	uint32_t magic;
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	int32_t frames;
+	uint64_t frame_offset;
+
+	// last published frame number, 0 before the first frame
+	std::atomic<uint64_t> sequence;
+
+	slot slots[max_frames];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, 
+	"frame sequence numbers must be lock free to be shared between processes");
+
+/**
+ * producer side: a ring of frames in a memfd (or a named POSIX shared
+ * memory object) that a Draw renders into directly. The memfd is sealed
+ * against resizing; a named object is not, and is for trusted peers only
+ */
+
+class shm_output
+{
+	int m_fd {-1};
+	uint8_t *m_map {nullptr};
+	size_t m_size {0};
+	shm_header *m_header {nullptr};
+	uint64_t m_sequence {0};
+	std::string m_name;
+
+	// closes and unlinks the memory, then throws
+	[[noreturn]] void release(const char *what);
+
+public:
+
+	/**
+	 * throws std::system_error when the memory cannot be created
+	 */
+
+	shm_output(int w, int h, int frames = 3, const char *name = nullptr);
+	~shm_output();
+
+	shm_output(const shm_output &) = delete;
+	shm_output &operator=(const shm_output &) = delete;
+
+	/**
+	 * the descriptor to pass to the host process (e.g. over a unix socket)
+	 */
+
+	int fd() {return m_fd;}
+
+	/**
+	 * claims the next slot of the ring and binds draw to it
+	 */
+
+	void begin_frame(Draw *draw);
+
+	/**
+	 * publishes the frame; an empty damage list means the whole frame
+	 */
+
+	void end_frame(slice<rect> damage = {});
+};
+
+/**
+ * consumer side, in the host process
+ */
+
+class shm_input
+{
+	int m_fd {-1};
+	uint8_t *m_map {nullptr};
+	size_t m_size {0};
+	shm_header *m_header {nullptr};
+
+	// geometry checked by map() against the size of the mapping; the
+	// header stays writable by the producer and is not read again
+	int m_width {0};
+	int m_height {0};
+	int m_stride {0};
+	int m_frames {0};
+	size_t m_frame_offset {0};
+	size_t m_frame_size {0};
+
+	// sealed: reject a descriptor that could still be resized
+	void map(int fd, bool sealed);
+
+public:
+
+	struct frame
+	{
+		const uint8_t *pixels;
+		int width, height, stride;
+		uint64_t sequence;
+		uint64_t publish_ns;
+
+		// damage since the frame the caller saw last; full when it
+		// could not be tracked (too many rects or skipped frames)
+		bool full;
+		uint32_t damage_count;
+		rect damage[shm_header::max_damage];
+	};
+
+	/**
+	 * maps a descriptor received from the producer (a duplicate is kept),
+	 * which must be sealed as shm_output seals its memfd, or a named
+	 * object, whose producer must be trusted not to shrink it; throws
+	 * std::system_error on failure
+	 */
+
+	shm_input(int fd);
+	shm_input(const char *name);
+	~shm_input();
+
+	shm_input(const shm_input &) = delete;
+	shm_input &operator=(const shm_input &) = delete;
+
+	/**
+	 * fills f with the newest frame when it is newer than last_seen
+	 */
+
+	bool acquire(uint64_t last_seen, frame &f);
+
+	/**
+	 * true while the producer has not started to overwrite f; check it
+	 * after presenting the pixels
+	 */
+
+	bool valid(const frame &f);
+};
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds, comparable between processes
+ */
+
+uint64_t monotonic_ns();
+
+
+} // abcd
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// text through the glyph atlas against text through cairo: the same
+// lines of labels drawn into the same Draw with and without
+// set_glyph_atlas(), after a warm-up frame that fills the atlas.
+//
+//   g++ -std=c++17 -O2 -I.. atlas_text.cpp ../abcdfont.cpp $(pkg-config --cflags --libs cairomm-1.0 freetype2) -o atlas_text
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "abcddraw.h"
+#include "abcdatlas.h"
+
+using namespace abcd;
+
+static double now_us()
+{
+	using namespace std::chrono;
+	return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void frame(Draw *d)
+{
+	static const char *labels[] = {"Volume", "Pan", "Cutoff 1200 Hz", "Resonance", 
+		"Attack 12 ms", "Release 340 ms", "Track 07: Bass", "Mute  Solo  Arm"};
+
+	d->set_solid_paint({0, 0, 0, 255});
+	d->fill_rectangle({0, 0, d->width(), d->height()});
+
+	d->set_font("sans", 13);
+	d->set_solid_paint({230, 230, 230, 255});
+
+	for (int i = 0; i < 200; ++i)
+	{
+		int x = (i % 4) * 160;
+		int y = (i / 4) * 18;
+		d->text(labels[i % 8], {x + 4, y, x + 156, y + 18}, -1, 0);
+	}
+}
+
+static double run(Draw *d, int frames)
+{
+	frame(d);
+	d->flush();
+
+	double t0 = now_us();
+	for (int f = 0; f < frames; ++f)
+	{
+		frame(d);
+		d->flush();
+	}
+
+	return (now_us() - t0) / frames;
+}
+
+int main(int argc, char **argv)
+{
+	const int frames = argc > 1 ? atoi(argv[1]) : 200;
+
+	Draw draw(640, 900, 1);
+	glyph_atlas atlas;
+
+	double cairo = run(&draw, frames);
+
+	draw.set_glyph_atlas(&atlas);
+	double atlased = run(&draw, frames);
+
+	printf("200 labels  cairo %.1f us  atlas %.1f us  (%.1fx)\n", 
+		cairo, atlased, cairo / atlased);
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// cost of the display list: a frame of widget-like calls recorded with
+// render off (encoding only), replayed into a Draw that records with
+// render off (decoding plus encoding again) and replayed into a Draw
+// that rasterizes, against drawing the same frame directly.
+//
+//   g++ -std=c++17 -O2 -I.. display_list.cpp ../abcdfont.cpp $(pkg-config --cflags --libs cairomm-1.0 freetype2) -o display_list
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "abcddraw.h"
+
+using namespace abcd;
+
+static double now_us()
+{
+	using namespace std::chrono;
+	return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+// a toolbar, a column of buttons and a list, moving a little each frame
+
+static void frame(Draw *d, int f)
+{
+	static const char *labels[] = {"Open", "Save", "Close", "Undo", "Redo", "Cut", "Copy", "Paste"};
+
+	d->set_font("sans", 12);
+
+	d->set_solid_paint({40, 40, 40, 255});
+	d->fill_rectangle({0, 0, 640, 480});
+
+	d->set_solid_paint({60, 60, 60, 255});
+	d->fill_rectangle({0, 0, 640, 28});
+
+	for (int i = 0; i < 8; ++i)
+	{
+		rect r(4 + i * 64, 4, 64 + i * 64, 24);
+		d->set_solid_paint({80, 80, 80, 255});
+		d->fill_rounded_rectangle(r, 3, 3);
+		d->set_solid_paint({220, 220, 220, 255});
+		d->text(labels[i], r, 0, 0);
+	}
+
+	d->push();
+	d->clip({0, 32, 320, 480});
+	d->translate({0, -(f % 20)});
+
+	for (int i = 0; i < 40; ++i)
+	{
+		rect r(8, 36 + i * 22, 312, 56 + i * 22);
+		d->set_solid_paint(i == f % 40 ? color{90, 120, 200, 255} : color{50, 50, 50, 255});
+		d->fill_rectangle(r);
+		d->set_solid_paint({200, 200, 200, 255});
+		d->text(labels[i % 8], r, -1, 0);
+	}
+
+	d->pop();
+
+	d->set_solid_paint({150, 150, 150, 255});
+	d->stroke_rectangle({330, 36, 630, 470});
+}
+
+int main(int argc, char **argv)
+{
+	const int frames = argc > 1 ? atoi(argv[1]) : 1000;
+
+	Draw direct(640, 480, 1);
+	Draw recorder(640, 480, 1);
+	Draw decoder(640, 480, 1);
+	Draw target(640, 480, 1);
+
+	display_list list, sink;
+	display_player player, raster;
+
+	recorder.record(&list, false);
+	decoder.record(&sink, false);
+
+	double encode = 0, decode = 0, replay = 0, draw = 0;
+	size_t bytes = 0;
+
+	for (int f = 0; f < frames; ++f)
+	{
+		double t0 = now_us();
+		list.begin_frame();
+		frame(&recorder, f);
+		double t1 = now_us();
+
+		sink.begin_frame();
+		player.play(list.data(), list.size(), &decoder);
+		double t2 = now_us();
+
+		raster.play(list.data(), list.size(), &target);
+		target.flush();
+		double t3 = now_us();
+
+		frame(&direct, f);
+		direct.flush();
+		double t4 = now_us();
+
+		encode += t1 - t0;
+		decode += t2 - t1 - (t1 - t0);
+		replay += t3 - t2;
+		draw += t4 - t3;
+		bytes += list.size();
+	}
+
+	printf("frames %d  bytes/frame %.0f\n", frames, double(bytes) / frames);
+	printf("encode %.2f us  decode %.2f us  replay %.2f us  direct %.2f us\n", 
+		encode / frames, decode / frames, replay / frames, draw / frames);
+
+	return 0;
+}
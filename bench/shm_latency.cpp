@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// publish-to-acquire latency of the shared-memory frame ring between two
+// processes: the child maps the ring and acquires frames as the parent
+// draws them, and checks each one carries the number it was drawn with.
+//
+//   g++ -std=c++17 -O2 -I.. shm_latency.cpp ../abcdshm.cpp ../abcdfont.cpp \
+//       $(pkg-config --cflags --libs cairomm-1.0 freetype2) -o shm_latency
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "abcdshm.h"
+
+using namespace abcd;
+
+int main(int argc, char **argv)
+{
+	const uint32_t frames = argc > 1 ? atoi(argv[1]) : 1000;
+	const int w = 64, h = 32;
+
+	shm_output out(w, h, 3);
+
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		shm_input in(out.fd());
+		shm_input::frame f;
+		uint64_t last = 0, latency = 0;
+		uint32_t seen = 0, torn = 0;
+
+		while (last < frames)
+		{
+			if (!in.acquire(last, f))
+				continue;
+
+			uint32_t v;
+			memcpy(&v, f.pixels, 4);
+
+			if (in.valid(f) && v != f.sequence)
+				++torn;
+
+			latency += monotonic_ns() - f.publish_ns;
+			last = f.sequence;
+			++seen;
+		}
+
+		printf("frames %u  acquired %u  torn %u  mean latency %.2f us\n", 
+			frames, seen, torn, latency / 1000.0 / seen);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	Draw draw(nullptr, 1, 1);
+
+	for (uint32_t i = 1; i <= frames; ++i)
+	{
+		out.begin_frame(&draw);
+
+		uint32_t *p = (uint32_t *)draw.pixels();
+		for (int k = 0; k < w * h; ++k)
+			p[k] = i;
+
+		rect r(0, 0, 8, 8);
+		out.end_frame({r});
+
+		usleep(100);
+	}
+
+	waitpid(pid, nullptr, 0);
+	return 0;
+}
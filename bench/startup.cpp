@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// time to the first frame of a window in a fresh process: from the
+// start to the end of a first frame of widgets drawn into a new Draw.
+// Each mode runs in its own child, so nothing is resolved beforehand:
+//
+//   toy            the theme font through the cairo toy API (fontconfig)
+//   file           the theme font loaded from a file by add_file()
+//   toy prewarm    as toy, with prewarm() while the Draw is created
+//   file prewarm   as file, with prewarm() while the Draw is created
+//
+//   g++ -std=c++17 -O2 -I.. startup.cpp ../abcdgui.cpp ../abcdfont.cpp ../abcdpixel.cpp ../abcdprofile.cpp $(pkg-config --cflags --libs cairomm-1.0 freetype2) -pthread -o startup
+//   ./startup [font file] [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+
+#include "abcdgui.h"
+#include "abcdfont.h"
+
+using namespace abcd;
+
+static double now_us()
+{
+	using namespace std::chrono;
+	return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double first_frame(const char *path, bool prewarm)
+{
+	double t0 = now_us();
+
+	window win;
+
+	if (path && !font_registry::instance().add_file(win.m_theme.font_family(), path))
+	{
+		fprintf(stderr, "cannot load %s\n", path);
+		_exit(1);
+	}
+
+	if (prewarm)
+		win.prewarm();
+
+	Draw draw(800, 600, 1);
+
+	float value = 0.5f;
+	bool check = true;
+
+	win.begin(&draw);
+
+	for (int i = 0; i < 8; ++i)
+	{
+		char name[16];
+		snprintf(name, sizeof(name), "button %d", i);
+		button(&win, name, {10, 10 + i * 30, 150, 34 + i * 30}, name);
+	}
+
+	checkbutton(&win, "check", {170, 10, 194, 34}, &check);
+	slider(&win, "slider", {170, 50, 470, 70}, 20, &value, true);
+
+	win.end();
+	draw.flush();
+
+	return now_us() - t0;
+}
+
+// mean of runs children, each timing one cold first frame
+
+static double cold(const char *path, bool prewarm, int runs)
+{
+	double sum = 0;
+
+	for (int i = 0; i < runs; ++i)
+	{
+		int fd[2];
+		if (pipe(fd) != 0)
+			exit(1);
+
+		pid_t pid = fork();
+
+		if (pid == 0)
+		{
+			close(fd[0]);
+			double us = first_frame(path, prewarm);
+			write(fd[1], &us, sizeof(us));
+			_exit(0);
+		}
+
+		close(fd[1]);
+
+		double us = 0;
+		if (read(fd[0], &us, sizeof(us)) != sizeof(us))
+			exit(1);
+
+		close(fd[0]);
+		waitpid(pid, nullptr, 0);
+		sum += us;
+	}
+
+	return sum / runs;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+	const int runs = argc > 2 ? atoi(argv[2]) : 10;
+
+	printf("toy            %.0f us\n", cold(nullptr, false, runs));
+	printf("file           %.0f us\n", cold(path, false, runs));
+	printf("toy prewarm    %.0f us\n", cold(nullptr, true, runs));
+	printf("file prewarm   %.0f us\n", cold(path, true, runs));
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 Alessandro De Santis
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+// the string and color tables of a display list stay bounded when every
+// frame brings new text and colors (a clock, a meter), on the recording
+// side and on the player, and the frames after a reset still replay.
+//
+//   g++ -std=c++17 -I.. display_list_tables.cpp ../abcdfont.cpp $(pkg-config --cflags --libs cairomm-1.0 freetype2) -o display_list_tables
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "abcddraw.h"
+
+using namespace abcd;
+
+#define check(e) \
+	do { if (!(e)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #e); exit(1); } } while (0)
+
+int main()
+{
+	const int frames = 20000;
+
+	Draw recorder(64, 32, 1);
+	Draw target(64, 32, 1);
+
+	display_list list;
+	display_player player;
+
+	recorder.record(&list, false);
+
+	size_t most = 0;
+
+	for (int f = 0; f < frames; ++f)
+	{
+		char s[32];
+		snprintf(s, sizeof(s), "%d ms", f);
+
+		list.begin_frame();
+		recorder.set_font("sans", 12);
+		recorder.set_solid_paint({uint8_t(f), uint8_t(f >> 8), 0, 255});
+		recorder.text(s, {0, 0, 64, 32}, 0, 0);
+
+		check(list.strings() <= display_list::max_strings + 2);
+		check(list.colors() <= display_list::max_colors + 1);
+
+		check(player.play(list.data(), list.size(), &target));
+		check(player.strings() == list.strings());
+		check(player.colors() == list.colors());
+
+		most = std::max(most, list.strings());
+	}
+
+	printf("%d frames, at most %zu strings\n", frames, most);
+	return 0;
+}